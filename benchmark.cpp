@@ -0,0 +1,449 @@
+#include "SDL_log.h"
+#include "include/arena.h"
+#include "include/sample_bank.h"
+#include "include/sample_buffer.h"
+#include "include/sample_library.h"
+#include "include/simd.h"
+#include "include/synthesis.h"
+#include "include/synthesis_clap_envelope.h"
+#include "include/synthesis_frequency_modulation.h"
+#include "include/synthesis_noise.h"
+#include "include/synthesis_physical_modeling.h"
+#include "include/synthesis_subtractive.h"
+#include "include/synthesis_type.h"
+#include "include/synthesis_wavetable.h"
+#include "include/synthesizer_settings.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Measures ns/sample and realtime factor for every engine and for the DSP
+// building blocks they are made of, with static and heavily modulated
+// parameters at several block sizes. Results are printed as JSON so runs can
+// be diffed or plotted.
+
+static const float SAMPLE_RATE = 48000;
+static const size_t BLOCK_SIZES[] = {1, 64, 256};
+static const size_t MAX_BLOCK_SIZE = 256;
+
+enum Modulation { STATIC, MODULATED };
+static const Modulation Modulations[] = {STATIC, MODULATED};
+
+static const char *getModulationName(Modulation modulation) {
+  switch (modulation) {
+  case STATIC:
+    return "static";
+  case MODULATED:
+    return "modulated";
+  }
+  return "";
+}
+
+struct BenchmarkResult {
+  std::string group;
+  std::string subject;
+  Modulation modulation;
+  size_t blockSize;
+  size_t numSamples;
+  double nsPerSample;
+  double realtimeFactor;
+};
+
+// keeps the compiler from discarding the rendered audio
+static volatile float benchmarkSink = 0;
+
+// control-rate sweep used for the modulated runs; one value per block
+static inline float modulationAt(const size_t sampleIndex, const float rateHz) {
+  return 0.5f + 0.5f * sinf(2.0f * float(M_PI) * rateHz * float(sampleIndex) /
+                            SAMPLE_RATE);
+}
+
+// RenderBlockT(size_t sampleIndex, size_t blockSize) renders one block and
+// returns some value derived from it
+template <typename RenderBlockT>
+static BenchmarkResult measure(const std::string &group,
+                               const std::string &subject,
+                               const Modulation modulation,
+                               const size_t blockSize, const size_t numSamples,
+                               RenderBlockT renderBlock) {
+  // warm caches and let envelopes get going before timing
+  size_t sampleIndex = 0;
+  for (; sampleIndex < numSamples / 10; sampleIndex += blockSize) {
+    benchmarkSink = benchmarkSink + renderBlock(sampleIndex, blockSize);
+  }
+  const size_t timedStart = sampleIndex;
+  const auto start = std::chrono::steady_clock::now();
+  for (; sampleIndex < timedStart + numSamples; sampleIndex += blockSize) {
+    benchmarkSink = benchmarkSink + renderBlock(sampleIndex, blockSize);
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  const size_t timedSamples = sampleIndex - timedStart;
+  const double seconds = std::chrono::duration<double>(stop - start).count();
+  return {.group = group,
+          .subject = subject,
+          .modulation = modulation,
+          .blockSize = blockSize,
+          .numSamples = timedSamples,
+          .nsPerSample = seconds * 1e9 / double(timedSamples),
+          .realtimeFactor =
+              seconds > 0 ? (double(timedSamples) / SAMPLE_RATE) / seconds : 0};
+}
+
+// the sampler needs something in its bank; a few seconds of detuned saws
+static void fillSyntheticSampleBank(SampleBank<float> *bank, Arena *arena) {
+  const size_t numSamples = 4;
+  const size_t bufferSize = size_t(SAMPLE_RATE * 2);
+  for (size_t i = 0; i < numSamples; ++i) {
+    auto sampleBuffer = new (arena->push<SampleBuffer<float>>())
+        SampleBuffer<float>(arena, SAMPLE_RATE, bufferSize, 1);
+    const float frequency = 110.0f * float(i + 1);
+    for (size_t n = 0; n < bufferSize; ++n) {
+      const float phase = fmodf(frequency * float(n) / SAMPLE_RATE, 1.0f);
+      sampleBuffer->buffer[n] = 2.0f * phase - 1.0f;
+    }
+    bank->publish(sampleBuffer, NULL);
+  }
+}
+
+static const char *getSynthName(SynthesizerType synthType) {
+  switch (synthType) {
+  case SUBTRACTIVE_DRUM_SYNTH:
+    return "drum";
+  case SUBTRACTIVE:
+    return "subtractive";
+  case PHYSICAL_MODEL:
+    return "physical_model";
+  case FREQUENCY_MODULATION:
+    return "fm";
+  case SAMPLER:
+    return "sampler";
+  }
+  return "";
+}
+
+static BenchmarkResult benchmarkEngine(SynthesizerType synthType,
+                                       Modulation modulation,
+                                       size_t blockSize, size_t numSamples,
+                                       SampleLibrary<float> *library,
+                                       Arena *delayTimeArena) {
+  seedNoise(1);
+  Synthesizer<float> *synth =
+      new Synthesizer<float>(library, delayTimeArena, SynthesizerSettings());
+  synth->pushEventAt(SynthesizerEvent<float>(synthType), 0);
+  synth->pushEventAt(ParameterChangeEvent<float>{.type = FILTER_CUTOFF,
+                                                 .value = 0.6},
+                     0);
+  synth->pushEventAt(ParameterChangeEvent<float>{.type = SOUND_SOURCE,
+                                                 .value = 0.5},
+                     0);
+
+  // a new note every quarter second on rotating keys, so several voices are
+  // held or releasing at any time
+  const size_t notePeriod = size_t(SAMPLE_RATE / 4);
+  const size_t numKeys = 4;
+  std::vector<float> block(MAX_BLOCK_SIZE);
+  auto renderBlock = [&](size_t sampleIndex, size_t size) {
+    const uint64_t frame = synth->renderedFrames;
+    if ((sampleIndex % notePeriod) < size) {
+      const int key = int((sampleIndex / notePeriod) % numKeys);
+      synth->pushEventAt(GateEvent<float>{.value = 0,
+                                          .voiceKey = int((key + numKeys - 1) %
+                                                          numKeys)},
+                         frame);
+      synth->pushEventAt(ParameterChangeEvent<float>{
+                             .type = FREQUENCY,
+                             .value = 110.0f * float(key + 1)},
+                         frame);
+      synth->pushEventAt(GateEvent<float>{.value = 1, .voiceKey = key}, frame);
+    }
+    if (modulation == MODULATED) {
+      synth->pushEventAt(
+          ParameterChangeEvent<float>{.type = FILTER_CUTOFF,
+                                      .value = modulationAt(sampleIndex, 3)},
+          frame);
+      synth->pushEventAt(
+          ParameterChangeEvent<float>{.type = FILTER_QUALITY,
+                                      .value = modulationAt(sampleIndex, 0.7)},
+          frame);
+      synth->pushEventAt(
+          ParameterChangeEvent<float>{.type = SOUND_SOURCE,
+                                      .value = modulationAt(sampleIndex, 1.3)},
+          frame);
+      synth->pushEventAt(
+          ParameterChangeEvent<float>{
+              .type = FREQUENCY,
+              .value = 110.0f + 330.0f * modulationAt(sampleIndex, 5)},
+          frame);
+    }
+    synth->process(block.data(), size);
+    return block[size - 1];
+  };
+  BenchmarkResult result = measure("engine", getSynthName(synthType),
+                                   modulation, blockSize, numSamples,
+                                   renderBlock);
+  delete synth;
+  delayTimeArena->clear();
+  return result;
+}
+
+static void benchmarkComponents(Modulation modulation, size_t blockSize,
+                                size_t numSamples, Arena *arena,
+                                std::vector<BenchmarkResult> *results) {
+  const size_t notePeriod = size_t(SAMPLE_RATE / 4);
+  const bool modulated = modulation == MODULATED;
+
+  {
+    seedNoise(1);
+    MultiOscillator<float> oscillator;
+    oscillator.setFrequency(220, SAMPLE_RATE);
+    oscillator.oscMix = 0.4;
+    results->push_back(measure(
+        "component", "MultiOscillator", modulation, blockSize, numSamples,
+        [&](size_t sampleIndex, size_t size) {
+          if (modulated) {
+            oscillator.setFrequency(
+                110.0f + 880.0f * modulationAt(sampleIndex, 5), SAMPLE_RATE);
+            oscillator.oscMix = modulationAt(sampleIndex, 1.3);
+          }
+          float out = 0;
+          for (size_t n = 0; n < size; ++n) {
+            out += oscillator.next();
+          }
+          return out;
+        }));
+  }
+
+  {
+    seedNoise(1);
+    WavetableOscillator<float> oscillator;
+    oscillator.setFrequency(220, SAMPLE_RATE);
+    oscillator.oscMix = 0.4;
+    results->push_back(measure(
+        "component", "WavetableOscillator", modulation, blockSize, numSamples,
+        [&](size_t sampleIndex, size_t size) {
+          if (modulated) {
+            oscillator.setFrequency(
+                110.0f + 880.0f * modulationAt(sampleIndex, 5), SAMPLE_RATE);
+            oscillator.oscMix = modulationAt(sampleIndex, 1.3);
+          }
+          float out = 0;
+          for (size_t n = 0; n < size; ++n) {
+            out += oscillator.next();
+          }
+          return out;
+        }));
+  }
+
+  {
+    ClapEnvelope<float> envelope;
+    envelope.set(10, 300, SAMPLE_RATE);
+    results->push_back(measure(
+        "component", "ClapEnvelope", modulation, blockSize, numSamples,
+        [&](size_t sampleIndex, size_t size) {
+          if (modulated) {
+            envelope.set(1 + 50 * modulationAt(sampleIndex, 2),
+                         50 + 500 * modulationAt(sampleIndex, 0.5),
+                         SAMPLE_RATE);
+          }
+          float out = 0;
+          for (size_t n = 0; n < size; ++n) {
+            envelope.setGate(((sampleIndex + n) % notePeriod) <
+                             notePeriod / 2);
+            out += envelope.next();
+          }
+          return out;
+        }));
+  }
+
+  {
+    seedNoise(1);
+    const Arena::Marker marker = arena->mark();
+    StringVoice<float> voice(arena);
+    voice.init();
+    voice.frequency.set(220, 5, SAMPLE_RATE);
+    voice.soundSource = 0.5;
+    results->push_back(measure(
+        "component", "StringVoice", modulation, blockSize, numSamples,
+        [&](size_t sampleIndex, size_t size) {
+          if (modulated) {
+            voice.frequency.set(110.0f + 330.0f * modulationAt(sampleIndex, 5),
+                                5, SAMPLE_RATE);
+            voice.brightness.set(modulationAt(sampleIndex, 3), 33,
+                                 SAMPLE_RATE);
+            voice.soundSource = modulationAt(sampleIndex, 1.3);
+          }
+          float out = 0;
+          for (size_t n = 0; n < size; ++n) {
+            voice.setGate(((sampleIndex + n) % notePeriod) < notePeriod / 2);
+            out += voice.next();
+          }
+          return out;
+        }));
+    arena->reset(marker);
+  }
+
+  {
+    FM4OpVoice<float> voice;
+    voice.frequency.set(220, 5, SAMPLE_RATE);
+    voice.index.set(0.5, 5, SAMPLE_RATE);
+    results->push_back(measure(
+        "component", "FM4OpVoice", modulation, blockSize, numSamples,
+        [&](size_t sampleIndex, size_t size) {
+          if (modulated) {
+            voice.frequency.set(110.0f + 330.0f * modulationAt(sampleIndex, 5),
+                                5, SAMPLE_RATE);
+            voice.index.set(modulationAt(sampleIndex, 3), 33, SAMPLE_RATE);
+            voice.activeTopology =
+                (FM4OpVoice<float>::NUM_ALGS - 1) *
+                modulationAt(sampleIndex, 0.7);
+          }
+          float out = 0;
+          for (size_t n = 0; n < size; ++n) {
+            voice.setGate(((sampleIndex + n) % notePeriod) < notePeriod / 2);
+            out += voice.next();
+          }
+          return out;
+        }));
+  }
+
+  {
+    const Arena::Marker marker = arena->mark();
+    const size_t bufferSize = size_t(SAMPLE_RATE * 2);
+    SampleBuffer<float> sampleBuffer(arena, SAMPLE_RATE, bufferSize, 1);
+    for (size_t n = 0; n < bufferSize; ++n) {
+      sampleBuffer.buffer[n] = sinf(2.0f * float(M_PI) * 220.0f * float(n) /
+                                    SAMPLE_RATE);
+    }
+    float phase = 0;
+    float phaseIncrement = 1.0f / float(bufferSize);
+    results->push_back(measure(
+        "component", "SampleBuffer::read", modulation, blockSize, numSamples,
+        [&](size_t sampleIndex, size_t size) {
+          if (modulated) {
+            phaseIncrement = (0.25f + 2.0f * modulationAt(sampleIndex, 5)) /
+                             float(bufferSize);
+          }
+          float out = 0;
+          for (size_t n = 0; n < size; ++n) {
+            out += sampleBuffer.read(phase);
+            phase += phaseIncrement;
+            phase = phase >= 1 ? phase - 1 : phase;
+          }
+          return out;
+        }));
+    arena->reset(marker);
+  }
+
+  {
+    const Arena::Marker marker = arena->mark();
+    const size_t bufferSize = size_t(SAMPLE_RATE * 2);
+    SampleBuffer<float> sampleBuffer(arena, SAMPLE_RATE, bufferSize, 1,
+                                     1.0f / 32767.0f);
+    for (size_t n = 0; n < bufferSize; ++n) {
+      sampleBuffer.pcm16[n] = int16_t(32767.0f * sinf(2.0f * float(M_PI) *
+                                                      220.0f * float(n) /
+                                                      SAMPLE_RATE));
+    }
+    size_t start = 0;
+    alignas(Arena::CACHE_LINE) float decoded[4096];
+    results->push_back(measure(
+        "component", "SampleBuffer::decode int16", modulation, blockSize,
+        numSamples, [&](size_t sampleIndex, size_t size) {
+          float out = 0;
+          for (size_t n = 0; n < size; n += 4096) {
+            const size_t count = size - n < 4096 ? size - n : 4096;
+            start = start + count < bufferSize ? start : 0;
+            sampleBuffer.decode(start, count, decoded);
+            out += decoded[count - 1];
+            start += count;
+          }
+          return out;
+        }));
+    arena->reset(marker);
+  }
+}
+
+static void printJSON(FILE *out, const std::vector<BenchmarkResult> &results,
+                      const double secondsPerRun) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"sampleRate\": %d,\n", int(SAMPLE_RATE));
+  fprintf(out, "  \"simdLanes\": %d,\n", int(simd::LANES));
+  fprintf(out, "  \"secondsPerRun\": %g,\n", secondsPerRun);
+  fprintf(out, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchmarkResult &result = results[i];
+    fprintf(out,
+            "    {\"group\": \"%s\", \"subject\": \"%s\", "
+            "\"modulation\": \"%s\", \"blockSize\": %zu, \"samples\": %zu, "
+            "\"nsPerSample\": %.3f, \"realtimeFactor\": %.2f}%s\n",
+            result.group.c_str(), result.subject.c_str(),
+            getModulationName(result.modulation), result.blockSize,
+            result.numSamples, result.nsPerSample, result.realtimeFactor,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n");
+  fprintf(out, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+  double secondsPerRun = 2;
+  const char *outputPath = NULL;
+  for (int i = 1; i < argc; ++i) {
+    const std::string option = argv[i];
+    if (option == "--seconds" && i + 1 < argc) {
+      secondsPerRun = atof(argv[++i]);
+    } else if (option == "--output" && i + 1 < argc) {
+      outputPath = argv[++i];
+    } else {
+      printf("usage: %s [--seconds N] [--output results.json]\n", argv[0]);
+      return 1;
+    }
+  }
+  const size_t numSamples = size_t(secondsPerRun * SAMPLE_RATE);
+
+  const size_t arenaSizeSeconds = 60;
+  SampleLibrary<float> sampleLibrary =
+      SampleLibrary<float>(sizeof(float) * 48000 * 10,
+                           sizeof(float) * 48000 * arenaSizeSeconds);
+  Arena delayTimeArena =
+      Arena(1 << 20, sizeof(float) * 48000 * arenaSizeSeconds);
+  SampleKit<float> *sampleKit = sampleLibrary.createKit();
+  fillSyntheticSampleBank(&sampleKit->bank, &sampleKit->arena);
+  sampleLibrary.publish(sampleKit);
+
+  std::vector<BenchmarkResult> results;
+  for (auto synthType : SynthTypes) {
+    for (auto modulation : Modulations) {
+      for (auto blockSize : BLOCK_SIZES) {
+        results.push_back(benchmarkEngine(synthType, modulation, blockSize,
+                                          numSamples, &sampleLibrary,
+                                          &delayTimeArena));
+      }
+    }
+  }
+  for (auto modulation : Modulations) {
+    for (auto blockSize : BLOCK_SIZES) {
+      benchmarkComponents(modulation, blockSize, numSamples, &delayTimeArena,
+                          &results);
+    }
+  }
+
+  FILE *out = stdout;
+  if (outputPath != NULL) {
+    out = fopen(outputPath, "w");
+    if (out == NULL) {
+      SDL_LogError(0, "could not open %s", outputPath);
+      return 1;
+    }
+  }
+  printJSON(out, results, secondsPerRun);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
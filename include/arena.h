@@ -1,36 +1,175 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+
+// Bump allocator for sample buffers and delay lines. Memory comes in chunks
+// of chunkSize bytes, and a new chunk is only malloc'd when the current one
+// is full, up to maxSize in total. Nothing is freed until the arena is
+// destroyed: clear() and reset() rewind and keep the chunks for reuse.
+// Growing calls malloc, so the audio thread should only push into space
+// that was already reserved.
 class Arena {
+public:
+  // arrays start on a cache line, which also covers every SIMD width we use
+  static constexpr size_t CACHE_LINE = 64;
+
+  struct Marker {
+    void *chunk;
+    size_t position;
+    size_t usedBeforeChunk;
+  };
+
+  struct Stats {
+    size_t used = 0;
+    size_t highWaterMark = 0;
+    size_t reserved = 0;
+    size_t numChunks = 0;
+    size_t failedAllocations = 0;
+  };
+
 private:
-  char *data;
+  struct Chunk {
+    Chunk *next;
+    size_t size;
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  Chunk *first = NULL;
+  Chunk *current = NULL;
   size_t position = 0;
-  size_t size = 0;
+  size_t usedBeforeChunk = 0;
+  size_t chunkSize = 0;
+  size_t maxSize = 0;
+  Stats stats;
+
+  inline Chunk *allocateChunk(size_t size) {
+    if (stats.reserved + size > maxSize) {
+      return NULL;
+    }
+    Chunk *chunk = (Chunk *)malloc(sizeof(Chunk) + size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    stats.reserved += size;
+    ++stats.numChunks;
+    return chunk;
+  }
+
+  static inline size_t padding(const char *address, size_t alignment) {
+    const uintptr_t misalignment = uintptr_t(address) & (alignment - 1);
+    return misalignment == 0 ? 0 : alignment - misalignment;
+  }
+
+  // true if size bytes at alignment fit in the current chunk, a later one we
+  // already own, or a new one
+  inline bool fits(size_t size, size_t alignment) const {
+    if (current == NULL) {
+      return false;
+    }
+    char *top = current->data() + position;
+    if (position + padding(top, alignment) + size <= current->size) {
+      return true;
+    }
+    for (Chunk *chunk = current->next; chunk != NULL; chunk = chunk->next) {
+      if (padding(chunk->data(), alignment) + size <= chunk->size) {
+        return true;
+      }
+    }
+    const size_t needed = size + alignment;
+    return stats.reserved + (needed > chunkSize ? needed : chunkSize) <=
+           maxSize;
+  }
+
+  inline void *allocate(size_t size, size_t alignment) {
+    if (current == NULL) {
+      ++stats.failedAllocations;
+      return NULL;
+    }
+    char *top = current->data() + position;
+    size_t pad = padding(top, alignment);
+    while (position + pad + size > current->size) {
+      // move on to the next chunk we own, or splice in a new one big enough
+      Chunk *next = current->next;
+      if (next == NULL ||
+          padding(next->data(), alignment) + size > next->size) {
+        const size_t needed = size + alignment;
+        Chunk *grown = allocateChunk(needed > chunkSize ? needed : chunkSize);
+        if (grown == NULL) {
+          ++stats.failedAllocations;
+          return NULL;
+        }
+        grown->next = next;
+        current->next = grown;
+        next = grown;
+      }
+      usedBeforeChunk += position;
+      current = next;
+      position = 0;
+      top = current->data();
+      pad = padding(top, alignment);
+    }
+    position += pad + size;
+    const size_t used = usedBeforeChunk + position;
+    stats.used = used;
+    stats.highWaterMark =
+        used > stats.highWaterMark ? used : stats.highWaterMark;
+    return top + pad;
+  }
 
 public:
-  Arena(size_t _size) : size(_size), position(0), data((char *)malloc(_size)) {}
+  Arena(size_t _chunkSize, size_t _maxSize = SIZE_MAX)
+      : chunkSize(_chunkSize), maxSize(_maxSize) {
+    first = allocateChunk(chunkSize);
+    current = first;
+  }
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
   template <typename T> bool canAlloc() const {
-    return (position + sizeof(T)) < size;
+    return fits(sizeof(T), alignof(T));
   }
   template <typename T> bool canAllocArray(size_t length) const {
-    size_t desiredSize = (position + (sizeof(T) * length));
-    return desiredSize < size;
+    return fits(sizeof(T) * length, CACHE_LINE);
   }
+  // both return NULL when the arena is full
   template <typename T> T *push() {
-    size_t size = sizeof(T);
-    void *ptr = data + position;
-    position += size;
-    return (T *)ptr;
+    return (T *)allocate(sizeof(T), alignof(T));
   }
   template <typename T> T *pushArray(size_t length) {
-    size_t size = sizeof(T) * length;
-    void *ptr = data + position;
-    position += size;
-    return (T *)ptr;
-  }
-  template <typename T> void pop() { position -= sizeof(T); }
-  inline void clear() { position = 0; }
-  inline size_t getPosition() { return position; }
-  ~Arena() { free(data); }
+    return (T *)allocate(sizeof(T) * length, CACHE_LINE);
+  }
+
+  // everything pushed after mark() is released by reset(marker)
+  inline Marker mark() const { return {current, position, usedBeforeChunk}; }
+  inline void reset(const Marker &marker) {
+    current = (Chunk *)marker.chunk;
+    position = marker.position;
+    usedBeforeChunk = marker.usedBeforeChunk;
+    stats.used = usedBeforeChunk + position;
+  }
+  inline void clear() { reset({first, 0, 0}); }
+
+  // every chunk reserved so far, used or not
+  template <typename F> inline void forEachChunk(F visit) const {
+    for (Chunk *chunk = first; chunk != NULL; chunk = chunk->next) {
+      visit(chunk->data(), chunk->size);
+    }
+  }
+
+  inline size_t getPosition() const { return stats.used; }
+  inline const Stats &getStats() const { return stats; }
+
+  ~Arena() {
+    Chunk *chunk = first;
+    while (chunk != NULL) {
+      Chunk *next = chunk->next;
+      free(chunk);
+      chunk = next;
+    }
+  }
 };
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "SDL_timer.h"
+#include "triple_buffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct AudioLoadStats {
+  // wall time spent in the callback over the buffer period it had to fill
+  float load = 0;
+  float meanLoad = 0;
+  float peakLoad = 0;
+  uint32_t callbacks = 0;
+  // callbacks that took longer than their buffer period
+  uint32_t overruns = 0;
+  // callbacks that started well after the previous buffer ran out
+  uint32_t lateCallbacks = 0;
+};
+
+// Times every audio callback against its deadline. beginCallback/endCallback
+// run on the audio thread and only touch audio-owned state; the stats go to
+// the UI through a TripleBuffer once per callback.
+struct AudioLoadMeter {
+  static constexpr double MEAN_TIME_CONSTANT_SECONDS = 1.0;
+  static constexpr double PEAK_WINDOW_SECONDS = 2.0;
+  static constexpr double LATE_TOLERANCE = 1.5;
+
+  const double secondsPerTick = 1.0 / double(SDL_GetPerformanceFrequency());
+  Uint64 callbackStart = 0;
+  Uint64 previousCallbackStart = 0;
+  double previousPeriodSeconds = 0;
+  double windowSeconds = 0;
+  float windowPeak = 0;
+  float previousWindowPeak = 0;
+  AudioLoadStats stats;
+  TripleBuffer<AudioLoadStats> published;
+  // set by resume(), taken by the next callback
+  std::atomic<bool> resumePending = false;
+
+  // UI thread, before a paused device is started again: the gap since the
+  // last callback before the pause is not a late callback
+  inline void resume() { resumePending.store(true, std::memory_order_release); }
+
+  inline void beginCallback() { callbackStart = SDL_GetPerformanceCounter(); }
+
+  inline void endCallback(const size_t numFrames, const double sampleRate) {
+    const Uint64 callbackEnd = SDL_GetPerformanceCounter();
+    const double periodSeconds = double(numFrames) / sampleRate;
+    if (periodSeconds <= 0) {
+      return;
+    }
+    const double elapsedSeconds =
+        double(callbackEnd - callbackStart) * secondsPerTick;
+
+    const bool resumed =
+        resumePending.exchange(false, std::memory_order_acquire);
+    if (stats.callbacks > 0 && !resumed) {
+      const double intervalSeconds =
+          double(callbackStart - previousCallbackStart) * secondsPerTick;
+      if (intervalSeconds > LATE_TOLERANCE * previousPeriodSeconds) {
+        ++stats.lateCallbacks;
+      }
+    }
+    previousCallbackStart = callbackStart;
+    previousPeriodSeconds = periodSeconds;
+
+    stats.load = float(elapsedSeconds / periodSeconds);
+    if (stats.load > 1) {
+      ++stats.overruns;
+    }
+    const double meanCoefficient =
+        stats.callbacks == 0 ? 1.0
+                             : periodSeconds / MEAN_TIME_CONSTANT_SECONDS;
+    stats.meanLoad += float(meanCoefficient) * (stats.load - stats.meanLoad);
+
+    // peak over the current and the previous window, so it neither sticks
+    // forever nor drops to zero right after a window rolls over
+    windowPeak = stats.load > windowPeak ? stats.load : windowPeak;
+    windowSeconds += periodSeconds;
+    if (windowSeconds >= PEAK_WINDOW_SECONDS) {
+      previousWindowPeak = windowPeak;
+      windowPeak = 0;
+      windowSeconds = 0;
+    }
+    stats.peakLoad =
+        windowPeak > previousWindowPeak ? windowPeak : previousWindowPeak;
+    ++stats.callbacks;
+
+    published.writeBuffer() = stats;
+    published.publish();
+  }
+
+  // UI thread only
+  inline const AudioLoadStats &latest() { return published.latest(); }
+};
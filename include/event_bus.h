@@ -0,0 +1,145 @@
+#pragma once
+
+#include "SDL_log.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <rigtorp/SPSCQueue.h>
+
+// Queue from many producers into the audio thread without a lock on the
+// audio side. Every producer registers its own lane, a wait-free SPSC queue,
+// and must be the only thread pushing into it; the audio thread is the only
+// consumer of all of them. Events carry the frame they are due at, and the
+// audio thread merges the lanes by always taking the earliest front.
+//
+// Lanes are allocated at registration, which locks, so producers register
+// off the audio thread, typically when they are constructed. A lane lives as
+// long as the bus.
+template <typename event_t> struct EventBus {
+  static constexpr size_t MAX_LANES = 8;
+
+  struct Lane {
+    const char *name;
+    rigtorp::SPSCQueue<event_t> queue;
+    // pushes that found the lane full; producer thread
+    std::atomic<uint32_t> overflows = 0;
+    // deepest the audio thread has seen the lane since the last log
+    std::atomic<uint32_t> peakDepth = 0;
+
+    Lane(const char *_name, const size_t capacity)
+        : name(_name), queue(capacity) {}
+  };
+
+  size_t laneCapacity;
+  Lane *lanes[MAX_LANES] = {};
+  std::atomic<size_t> numLanes = 0;
+  std::mutex registrationMutex;
+
+  EventBus(const size_t _laneCapacity) : laneCapacity(_laneCapacity) {}
+
+  EventBus(const EventBus &) = delete;
+  EventBus &operator=(const EventBus &) = delete;
+
+  ~EventBus() {
+    for (size_t i = 0; i < numLanes.load(); ++i) {
+      delete lanes[i];
+    }
+  }
+
+  // a new lane for one producer, or NULL once every lane is taken
+  Lane *registerProducer(const char *name) {
+    std::lock_guard<std::mutex> lock(registrationMutex);
+    const size_t index = numLanes.load(std::memory_order_relaxed);
+    if (index >= MAX_LANES) {
+      SDL_LogError(0, "event bus: no lane left for %s", name);
+      return NULL;
+    }
+    lanes[index] = new Lane(name, laneCapacity);
+    numLanes.store(index + 1, std::memory_order_release);
+    return lanes[index];
+  }
+
+  // producer thread; counts and refuses the event when the lane is full
+  inline const bool tryPush(Lane *lane, const event_t &event) {
+    if (lane->queue.try_push(event)) {
+      return true;
+    }
+    lane->overflows.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // producer thread; waits for room rather than dropping the event
+  inline void push(Lane *lane, const event_t &event) {
+    if (!tryPush(lane, event)) {
+      lane->queue.push(event);
+    }
+  }
+
+  // Audio thread, once per block: records how deep each lane is.
+  inline void sampleDepths() {
+    const size_t count = numLanes.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+      const uint32_t depth = uint32_t(lanes[i]->queue.size());
+      if (depth > lanes[i]->peakDepth.load(std::memory_order_relaxed)) {
+        lanes[i]->peakDepth.store(depth, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Audio thread: the lane whose front event is due first, or NULL if all
+  // are empty. Frames further than horizon past now count as due now, so a
+  // producer with a stale clock cannot hold back the others. Ties go to the
+  // lane registered first.
+  inline Lane *earliest(const uint64_t now, const uint64_t horizon) {
+    const size_t count = numLanes.load(std::memory_order_acquire);
+    Lane *first = NULL;
+    uint64_t firstFrame = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const event_t *front = lanes[i]->queue.front();
+      if (front == nullptr) {
+        continue;
+      }
+      const uint64_t frame =
+          front->frame > now && front->frame - now <= horizon ? front->frame
+                                                              : now;
+      if (first == NULL || frame < firstFrame) {
+        first = lanes[i];
+        firstFrame = frame;
+      }
+    }
+    return first;
+  }
+
+  inline const uint32_t totalOverflows() const {
+    uint32_t total = 0;
+    const size_t count = numLanes.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+      total += lanes[i]->overflows.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+  // UI thread; logs the peak depth and overflows of every lane on one line
+  // and starts a new peak
+  void logStats() {
+    char text[256] = "event lanes:";
+    size_t length = strlen(text);
+    const size_t count = numLanes.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count && length < sizeof(text); ++i) {
+      Lane *lane = lanes[i];
+      const uint32_t peak =
+          lane->peakDepth.exchange(0, std::memory_order_relaxed);
+      const int written =
+          snprintf(text + length, sizeof(text) - length,
+                   " %s depth %u/%u overflows %u%s", lane->name, peak,
+                   uint32_t(laneCapacity),
+                   lane->overflows.load(std::memory_order_relaxed),
+                   i + 1 < count ? "," : "");
+      length += written > 0 ? size_t(written) : 0;
+    }
+    SDL_Log("%s", text);
+  }
+};
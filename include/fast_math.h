@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Cheap stand-ins for the libm calls in the per-sample paths. Every kernel
+// takes an accuracy tier as its first template argument; leaving it out uses
+// DEFAULT_MATH_ACCURACY, so the whole app can be moved between tiers in one
+// place. Error bounds were measured over the stated domains in double
+// precision; float adds its own rounding (about 1e-7 relative, or a few
+// 1e-6 absolute for log2 of very large or small inputs).
+//
+//                 MATH_FAST              MATH_ACCURATE
+//   fastTanh      2.4e-2 abs             9.6e-5 abs
+//   fastExp2      1.0e-4 rel             1.1e-7 rel        x in [-126, 126]
+//   fastLog2      8.8e-5 abs             4.3e-8 abs        x normal, > 0
+//   fastPow       from exp2/log2         from exp2/log2    base > 0
+//   fastMtof      1.7e-6 rel (both)                        note in [0, 135]
+//
+// MATH_EXACT forwards to libm, which is handy for A/B listening and for
+// checking that a problem is not caused by an approximation.
+enum MathAccuracy { MATH_FAST, MATH_ACCURATE, MATH_EXACT };
+
+static constexpr MathAccuracy DEFAULT_MATH_ACCURACY = MATH_ACCURATE;
+
+static constexpr double LOG2_E = 1.4426950408889634;
+static constexpr double SQRT_2 = 1.4142135623730951;
+
+// 2^exponent for an integer exponent, built directly in the exponent bits
+template <typename sample_t> inline sample_t powerOf2(const int exponent) {
+  if constexpr (std::is_same<sample_t, float>::value) {
+    const uint32_t bits = uint32_t(exponent + 127) << 23;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  } else {
+    const uint64_t bits = uint64_t(exponent + 1023) << 52;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return sample_t(value);
+  }
+}
+
+// splits x into 2^exponent * mantissa with mantissa in [sqrt(0.5), sqrt(2))
+template <typename sample_t>
+inline sample_t splitExponent(const sample_t x, int *exponent) {
+  sample_t mantissa;
+  if constexpr (std::is_same<sample_t, float>::value) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    *exponent = int((bits >> 23) & 0xff) - 127;
+    bits = (bits & 0x007fffffu) | 0x3f800000u;
+    std::memcpy(&mantissa, &bits, sizeof(mantissa));
+  } else {
+    double value = double(x);
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    *exponent = int((bits >> 52) & 0x7ff) - 1023;
+    bits = (bits & 0x000fffffffffffffull) | 0x3ff0000000000000ull;
+    std::memcpy(&value, &bits, sizeof(value));
+    mantissa = sample_t(value);
+  }
+  if (mantissa > sample_t(SQRT_2)) {
+    mantissa *= sample_t(0.5);
+    *exponent += 1;
+  }
+  return mantissa;
+}
+
+// Pade approximants of tanh, clamped where they reach +-1
+template <MathAccuracy ACCURACY = DEFAULT_MATH_ACCURACY, typename sample_t>
+inline sample_t fastTanh(sample_t x) {
+  switch (ACCURACY) {
+  case MATH_FAST: {
+    x = x < -3 ? -3 : (x > 3 ? 3 : x);
+    const sample_t x2 = x * x;
+    return x * (27 + x2) / (27 + 9 * x2);
+  }
+  case MATH_ACCURATE: {
+    const sample_t limit = 4.97;
+    x = x < -limit ? -limit : (x > limit ? limit : x);
+    const sample_t x2 = x * x;
+    return x * (135135 + x2 * (17325 + x2 * (378 + x2))) /
+           (135135 + x2 * (62370 + x2 * (3150 + 28 * x2)));
+  }
+  case MATH_EXACT:
+    break;
+  }
+  return tanh(x);
+}
+
+// 2^x as 2^round(x) * P(x - round(x)), P a Chebyshev fit on [-0.5, 0.5]
+template <MathAccuracy ACCURACY = DEFAULT_MATH_ACCURACY, typename sample_t>
+inline sample_t fastExp2(sample_t x) {
+  if (ACCURACY == MATH_EXACT) {
+    return exp2(x);
+  }
+  x = x < -126 ? -126 : (x > 126 ? 126 : x);
+  const sample_t rounded = sample_t(int(x + (x < 0 ? -0.5 : 0.5)));
+  const sample_t f = x - rounded;
+  sample_t p;
+  switch (ACCURACY) {
+  case MATH_FAST:
+    p = sample_t(0.999924557) +
+        f * (sample_t(0.693136734) +
+             f * (sample_t(0.242639479) + f * sample_t(0.0558382829)));
+    break;
+  case MATH_ACCURATE:
+  case MATH_EXACT:
+    p = sample_t(1.00000008) +
+        f * (sample_t(0.693147188) +
+             f * (sample_t(0.240221075) +
+                  f * (sample_t(0.0555035711) +
+                       f * (sample_t(0.00967603192) +
+                            f * sample_t(0.00133908634)))));
+    break;
+  }
+  return p * powerOf2<sample_t>(int(rounded));
+}
+
+template <MathAccuracy ACCURACY = DEFAULT_MATH_ACCURACY, typename sample_t>
+inline sample_t fastExp(const sample_t x) {
+  if (ACCURACY == MATH_EXACT) {
+    return exp(x);
+  }
+  return fastExp2<ACCURACY>(x * sample_t(LOG2_E));
+}
+
+// log2(x) = exponent + log2(m), log2(m) = 2/ln2 * atanh((m - 1) / (m + 1))
+// with the atanh series cut after two or four terms
+template <MathAccuracy ACCURACY = DEFAULT_MATH_ACCURACY, typename sample_t>
+inline sample_t fastLog2(const sample_t x) {
+  if (ACCURACY == MATH_EXACT) {
+    return log2(x);
+  }
+  int exponent;
+  const sample_t m = splitExponent(x, &exponent);
+  const sample_t s = (m - 1) / (m + 1);
+  const sample_t s2 = s * s;
+  sample_t series;
+  switch (ACCURACY) {
+  case MATH_FAST:
+    series = 1 + s2 * sample_t(1.0 / 3.0);
+    break;
+  case MATH_ACCURATE:
+  case MATH_EXACT:
+    series =
+        1 + s2 * (sample_t(1.0 / 3.0) +
+                  s2 * (sample_t(1.0 / 5.0) + s2 * sample_t(1.0 / 7.0)));
+    break;
+  }
+  return sample_t(exponent) + sample_t(2.0 * LOG2_E) * s * series;
+}
+
+// base^exponent for base > 0; returns 0 for base <= 0
+template <MathAccuracy ACCURACY = DEFAULT_MATH_ACCURACY, typename sample_t>
+inline sample_t fastPow(const sample_t base, const sample_t exponent) {
+  if (ACCURACY == MATH_EXACT) {
+    return pow(base, exponent);
+  }
+  if (base <= 0) {
+    return 0;
+  }
+  return fastExp2<ACCURACY>(exponent * fastLog2<ACCURACY>(base));
+}
+
+// midi note to Hz from a table at 1/16 semitone, linearly interpolated
+template <typename sample_t> struct MtofTable {
+  static constexpr int HIGHEST_NOTE = 135;
+  static constexpr size_t STEPS_PER_SEMITONE = 16;
+  static constexpr size_t TABLE_SIZE = HIGHEST_NOTE * STEPS_PER_SEMITONE + 2;
+  sample_t frequencies[TABLE_SIZE];
+
+  MtofTable() {
+    for (size_t i = 0; i < TABLE_SIZE; ++i) {
+      const double note = double(i) / double(STEPS_PER_SEMITONE);
+      frequencies[i] = sample_t(440.0 * pow(2.0, (note - 69.0) / 12.0));
+    }
+  }
+
+  static const MtofTable<sample_t> &instance() {
+    static const MtofTable<sample_t> table;
+    return table;
+  }
+};
+
+template <typename sample_t> inline sample_t fastMtof(const sample_t note) {
+  if (note < 0 || note > MtofTable<sample_t>::HIGHEST_NOTE) {
+    return sample_t(440) * fastExp2((note - sample_t(69)) / sample_t(12));
+  }
+  const MtofTable<sample_t> &table = MtofTable<sample_t>::instance();
+  const sample_t position =
+      note * sample_t(MtofTable<sample_t>::STEPS_PER_SEMITONE);
+  const size_t index = size_t(position);
+  const sample_t mantissa = position - sample_t(index);
+  return table.frequencies[index] +
+         mantissa * (table.frequencies[index + 1] - table.frequencies[index]);
+}
@@ -7,6 +7,7 @@
 #include "synthesis.h"
 #include "vector_math.h"
 #include <algorithm>
+#include <limits>
 #include <memory>
 
 struct Game {
@@ -17,17 +18,35 @@ struct Game {
   std::vector<std::unique_ptr<GameObject>> gameObjects;
   InputMapping<float> *mapping = NULL;
   Synthesizer<float> *synth = NULL;
-  std::vector<float> activeGateTimes;
+  Synthesizer<float>::EventLane *eventLane = NULL;
+  struct ActiveGate {
+    float time;
+    int voiceKey;
+  };
+  std::vector<ActiveGate> activeGates;
+  int nextCollisionKey = 0;
   float gateWidthSeconds = 0.1;
   AxisAlignedBoundingBox bounds;
 
   Game(InputMapping<float> *_mapping, Synthesizer<float> *_synth)
-      : mapping(_mapping), synth(_synth) {}
+      : mapping(_mapping), synth(_synth) {
+    eventLane = synth->registerEventProducer("game");
+  }
   inline const float computeNormalizedYCollisionPosition(float y) const {
     return 1 - (y - (bounds.position.y - bounds.halfSize.y)) /
                    (bounds.halfSize.y * 2.0);
   }
 
+  // every collision gets its own voice key so overlapping hits ring out on
+  // separate voices instead of cutting each other off
+  inline void triggerCollisionGate() {
+    const int voiceKey = nextCollisionKey;
+    nextCollisionKey = (nextCollisionKey + 1) % std::numeric_limits<int>::max();
+    mapping->emitEvent(synth, GAME, MomentaryInputType::COLLISION, true,
+                       voiceKey, eventLane);
+    activeGates.push_back(ActiveGate{.time = 0, .voiceKey = voiceKey});
+  }
+
   inline void update(float secondsSinceLastUpdate) {
     physics.update(secondsSinceLastUpdate, &gameObjects);
     auto biggerBounds = bounds;
@@ -40,18 +59,18 @@ struct Game {
                                 }),
                       gameObjects.end());
 
-    for (size_t i = 0; i < activeGateTimes.size(); i++) {
-      activeGateTimes[i] += secondsSinceLastUpdate;
-      if (activeGateTimes[i] >= gateWidthSeconds) {
-        mapping->emitEvent(synth, GAME, MomentaryInputType::COLLISION, false);
+    for (auto &gate : activeGates) {
+      gate.time += secondsSinceLastUpdate;
+      if (gate.time >= gateWidthSeconds) {
+        mapping->emitEvent(synth, GAME, MomentaryInputType::COLLISION, false,
+                           gate.voiceKey, eventLane);
       }
     }
-    activeGateTimes.erase(remove_if(activeGateTimes.begin(),
-                                    activeGateTimes.end(),
-                                    [this](auto gateTime) {
-                                      return (gateTime >= gateWidthSeconds);
-                                    }),
-                          activeGateTimes.end());
+    activeGates.erase(remove_if(activeGates.begin(), activeGates.end(),
+                                [this](auto &gate) {
+                                  return (gate.time >= gateWidthSeconds);
+                                }),
+                      activeGates.end());
 
     for (auto &collision : physics.getCollisions()) {
       auto obj1 = collision.object1;
@@ -78,9 +97,7 @@ struct Game {
                                ContinuousInputType::COLLISION_POSITION_Y,
                                computeNormalizedYCollisionPosition(
                                    p1.collider.getPosition().y));
-            mapping->emitEvent(synth, GAME, MomentaryInputType::COLLISION,
-                               true);
-            activeGateTimes.push_back(0);
+            triggerCollisionGate();
           }
           break;
         }
@@ -103,9 +120,7 @@ struct Game {
                                ContinuousInputType::COLLISION_POSITION_Y,
                                computeNormalizedYCollisionPosition(
                                    p1.collider.getPosition().y));
-            mapping->emitEvent(synth, GAME, MomentaryInputType::COLLISION,
-                               true);
-            activeGateTimes.push_back(0);
+            triggerCollisionGate();
           }
 
           break;
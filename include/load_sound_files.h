@@ -1,16 +1,27 @@
 #pragma once
 
+#include "SDL_timer.h"
+#include <functional>
+#include <thread>
+
 #ifdef PLATFORM_IS_ANDROID
 
+#include "sample_library.h"
 #include "sample_load.h"
 #include "synthesis_sampling.h"
 #include <SDL.h>
+#include <atomic>
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 #include <jni.h>
 #include <sstream>
 #include <string>
-inline void LoadSoundFiles(SampleBank<float> *bank) {
+// sample packs are not used on Android yet: assets live compressed inside
+// the APK and cannot be mapped, so pack is ignored
+inline void LoadSoundFiles(SampleBank<float> *bank,
+                           const std::string &directory = "sounds",
+                           const std::atomic<bool> *cancelled = NULL,
+                           MappedSamplePack *pack = NULL) {
   JNIEnv *env = (JNIEnv *)SDL_AndroidGetJNIEnv();
   jobject activity = (jobject)SDL_AndroidGetActivity();
   jclass clazz(env->GetObjectClass(activity));
@@ -27,32 +38,141 @@ inline void LoadSoundFiles(SampleBank<float> *bank) {
   jobject aJavaAssetManager = env->CallObjectMethod(aContext, aJavaMethodID);
   AAssetManager *mgr = AAssetManager_fromJava(env, aJavaAssetManager);
   SDL_Log("got manager %x", mgr);
-  AAssetDir *assetDir = AAssetManager_openDir(mgr, "sounds");
+  AAssetDir *assetDir = AAssetManager_openDir(mgr, directory.c_str());
   SDL_Log("got sounds dur %x", assetDir);
   const char *filename = (const char *)NULL;
   while ((filename = AAssetDir_getNextFileName(assetDir)) != NULL) {
+    if (cancelled != NULL && cancelled->load())
+      break;
       SDL_Log("about to load %s", filename);
       std::stringstream ss;
-      ss << "sounds/" << filename;
+      ss << directory << "/" << filename;
     bank->loadSample(ss.str());
   }
-  SDL_Log("bank has %d samples", bank->size);
+  SDL_Log("bank has %d samples", int(bank->size.load()));
   AAssetDir_close(assetDir);
   env->DeleteLocalRef(activity);
   env->DeleteLocalRef(clazz);
 }
 #else
+#include "sample_library.h"
 #include "sample_load.h"
 #include "synthesis_sampling.h"
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
-inline void LoadSoundFiles(SampleBank<float> *bank) {
+#include <string>
+#include <vector>
+
+// the pack is rebuilt whenever a file in sounds/ is newer than it
+static inline const bool
+SamplePackIsCurrent(const std::string &packPath,
+                    const std::vector<std::string> &wavPaths) {
+  std::error_code error;
+  const auto packTime = std::filesystem::last_write_time(packPath, error);
+  if (error) {
+    return false;
+  }
+  for (auto &wavPath : wavPaths) {
+    if (std::filesystem::last_write_time(wavPath, error) > packTime || error) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// With a pack, a directory such as sounds/ is decoded once into sounds.pack
+// and later launches map it instead of parsing every WAV file again. Without
+// one, or if the pack cannot be written, every file is loaded into the bank's
+// arena.
+inline void LoadSoundFiles(SampleBank<float> *bank,
+                           const std::string &directory = "sounds",
+                           const std::atomic<bool> *cancelled = NULL,
+                           MappedSamplePack *pack = NULL) {
   using std::filesystem::directory_iterator;
   using std::filesystem::path;
-  for (auto &entry : directory_iterator(path{"sounds"})) {
+  const std::string packPath = directory + ".pack";
+  std::vector<std::string> wavPaths;
+  std::error_code error;
+  for (auto &entry : directory_iterator(path{directory}, error)) {
     if (std::filesystem::is_directory(entry))
       continue;
+    wavPaths.push_back(entry.path().string());
+  }
+  std::sort(wavPaths.begin(), wavPaths.end());
 
-    bank->loadSample(entry.path().string());
+  if (pack != NULL) {
+    const uint32_t sampleRate = uint32_t(bank->sampleRate);
+    // a pack built for another engine rate would have to be copied to be
+    // converted, so build it again at this one; so is one that does not
+    // open, e.g. from an older pack version
+    if (!SamplePackIsCurrent(packPath, wavPaths) || !pack->open(packPath) ||
+        !pack->isAtRate(sampleRate)) {
+      pack->close();
+      WriteSamplePack(packPath, wavPaths, sampleRate);
+    }
+    if (pack->isOpen() || pack->open(packPath)) {
+      bank->loadSamplePack(*pack);
+      return;
+    }
+  }
+
+  for (auto &wavPath : wavPaths) {
+    if (cancelled != NULL && cancelled->load())
+      break;
+    bank->loadSample(wavPath);
   }
 }
 #endif
+
+// Decodes a sound directory into a new kit on its own thread, so neither
+// startup nor a kit change waits for it. The first kit is published straight
+// away and fills in while it plays, so the sampler has whatever has arrived
+// so far; later kits are published only once complete, so a change during a
+// performance swaps every sample in one step. onFinished runs on the loader
+// thread before a complete kit is published.
+struct BackgroundSampleLoader {
+  std::thread thread;
+  std::atomic<bool> cancelled = false;
+
+  inline void
+  start(SampleLibrary<float> *library, const std::string &directory = "sounds",
+        std::function<void(SampleKit<float> *)> onFinished = nullptr) {
+    stop();
+    cancelled.store(false);
+    thread = std::thread([this, library, directory, onFinished]() {
+      const Uint32 startTicks = SDL_GetTicks();
+      SampleKit<float> *kit = library->createKit();
+      const bool progressive = !library->hasKit();
+      if (progressive) {
+        library->publish(kit);
+      }
+      LoadSoundFiles(&kit->bank, directory, &cancelled, &kit->pack);
+      kit->loaded.store(true, std::memory_order_release);
+      SDL_Log("loaded %d samples from %s in %dms",
+              int(kit->bank.size.load()), directory.c_str(),
+              int(SDL_GetTicks() - startTicks));
+      if (onFinished) {
+        onFinished(kit);
+      }
+      if (progressive) {
+        return;
+      }
+      if (cancelled.load()) {
+        delete kit;
+      } else {
+        library->publish(kit);
+      }
+    });
+  }
+
+  // stops after the file being decoded and waits for the thread
+  inline void stop() {
+    cancelled.store(true);
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  ~BackgroundSampleLoader() { stop(); }
+};
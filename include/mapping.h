@@ -1,5 +1,6 @@
 #pragma once
 
+#include "fast_math.h"
 #include "metaphor.h"
 #include "pitch_collection.h"
 #include "synthesis.h"
@@ -85,6 +86,28 @@ static const char *getDisplayName(ContinuousInputType type) {
   return "";
 }
 
+// Inputs that only ever come with a note (a key, a step, a collision), as
+// opposed to ones that move on their own (sensors, a finger on the pad).
+static const bool isNoteInput(ContinuousInputType type) {
+  switch (type) {
+  case KEYBOARD_KEY:
+  case SEQUENCER_STEP_LEVEL:
+  case COLLISION_VELOCITY:
+  case COLLISION_POSITION_X:
+  case COLLISION_POSITION_Y:
+  case PARTICLE_SIZE:
+    return true;
+  case TILT:
+  case ACCELERATION:
+  case SPIN_VELOCITY:
+  case TOUCH_X_POSITION:
+  case TOUCH_Y_POSITION:
+  case ContinuousInputType_SIZE:
+    break;
+  }
+  return false;
+}
+
 enum MomentaryInputType {
   SHAKE,
   KEYBOARD_GATE,
@@ -246,6 +269,7 @@ struct ModeSpecificMapping {
 };
 
 template <typename sample_t> struct InputMapping {
+  typedef typename Synthesizer<sample_t>::EventLane EventLane;
 
   std::map<InstrumentMetaphorType, ModeSpecificMapping>
       instrumentModeSpecificMappings;
@@ -285,6 +309,25 @@ template <typename sample_t> struct InputMapping {
   }
   int key = 0;
   ScaleType scaleType = ScaleType::IONIAN_PENT;
+  // FREQUENCY from a note input, held for that mode's next gate. Each mode's
+  // note inputs and gates come from a single producer, so no locking.
+  sample_t notePitches[NUM_INSTRUMENT_METAPHOR_TYPES] = {};
+
+  // A note input's FREQUENCY is the pitch of the note about to be gated and
+  // rides along with that gate; sending it as a parameter move would retune
+  // whichever voice is still held.
+  inline void sendParameter(Synthesizer<sample_t> *synth,
+                            InstrumentMetaphorType instrumentMode,
+                            ContinuousInputType type,
+                            ContinuousParameterType parameterType,
+                            sample_t value) {
+    if (parameterType == FREQUENCY && isNoteInput(type)) {
+      notePitches[instrumentMode] = value;
+      return;
+    }
+    synth->pushParameterChangeEvent(parameterType, value);
+  }
+
   inline void emitEvent(Synthesizer<sample_t> *synth,
                         InstrumentMetaphorType instrumentMode,
                         ContinuousInputType type, sample_t value) {
@@ -299,11 +342,12 @@ template <typename sample_t> struct InputMapping {
       auto mappedValue = value;
       if (type == sensorType) {
         if (parameterEventType == FREQUENCY) {
-          mappedValue =
-              mtof(key + 36 + ForceToScale(value * 36.0, GetScale(scaleType)));
+          mappedValue = fastMtof<float>(
+              key + 36 + ForceToScale(value * 36.0, GetScale(scaleType)));
         }
 
-        synth->pushParameterChangeEvent(parameterEventType, mappedValue);
+        sendParameter(synth, instrumentMode, type, parameterEventType,
+                      mappedValue);
       }
     }
   }
@@ -321,20 +365,23 @@ template <typename sample_t> struct InputMapping {
       auto mappedValue = value;
       if (type == sensorType) {
         if (parameterEventType == FREQUENCY) {
-          mappedValue =
-              mtof(key + 36 + ForceToScale(value, GetScale(scaleType)));
+          mappedValue = fastMtof<float>(
+              key + 36 + ForceToScale(value, GetScale(scaleType)));
         } else {
           mappedValue /= numSteps;
         }
 
-        synth->pushParameterChangeEvent(parameterEventType, mappedValue);
+        sendParameter(synth, instrumentMode, type, parameterEventType,
+                      mappedValue);
       }
     }
   }
 
+  // producers with a lane of their own pass it so their gates stay on it
   inline void emitEvent(Synthesizer<sample_t> *synth,
                         InstrumentMetaphorType instrumentMode,
-                        MomentaryInputType type, sample_t value) {
+                        MomentaryInputType type, sample_t value,
+                        int voiceKey = 0, EventLane *lane = NULL) {
 
     auto &momentaryMappings =
         instrumentModeSpecificMappings[instrumentMode].momentaryMappings;
@@ -343,7 +390,12 @@ template <typename sample_t> struct InputMapping {
       auto parameterEventType = pair.first;
 
       if (type == sensorType) {
-        synth->pushGateEvent(parameterEventType, value);
+        sample_t pitch = 0;
+        if (value > 0) {
+          pitch = notePitches[instrumentMode];
+          notePitches[instrumentMode] = 0;
+        }
+        synth->pushGateEvent(parameterEventType, value, voiceKey, lane, pitch);
       }
     }
   }
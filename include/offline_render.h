@@ -0,0 +1,260 @@
+#pragma once
+
+#include "synthesis.h"
+#include "synthesis_parameter.h"
+#include "synthesis_type.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scripted, faster-than-realtime rendering of a Synthesizer with no window or
+// audio device. A script is one event per line, time in seconds first:
+//
+//   # comment
+//   0.0 engine subtractive      drum | subtractive | physical | fm | sampler
+//   0.0 param filter_cutoff 0.4 any name from getScriptName, frequency in Hz
+//   0.0 gate 1 3                value, optional voice key
+//   0.5 bend 440 660            note, destination note in Hz
+//   0.5 gate 0 3
+//   2.0 end                     render length, otherwise last event + 1s
+
+template <typename sample_t> struct ScriptedEvent {
+  uint64_t frame;
+  SynthesizerEvent<sample_t> event;
+};
+
+template <typename sample_t> struct RenderScript {
+  std::vector<ScriptedEvent<sample_t>> events;
+  uint64_t numFrames = 0;
+};
+
+static const char *getScriptName(ContinuousParameterType parameterType) {
+  switch (parameterType) {
+  case FREQUENCY:
+    return "frequency";
+  case GAIN:
+    return "gain";
+  case SOUND_SOURCE:
+    return "sound_source";
+  case FILTER_CUTOFF:
+    return "filter_cutoff";
+  case FILTER_QUALITY:
+    return "filter_quality";
+  case ATTACK_TIME:
+    return "attack";
+  case RELEASE_TIME:
+    return "release";
+  case OCTAVE:
+    return "octave";
+  case _SIZE_ContinuousParameterType:
+    break;
+  }
+  return "";
+}
+
+static const char *getScriptName(SynthesizerType synthType) {
+  switch (synthType) {
+  case SUBTRACTIVE_DRUM_SYNTH:
+    return "drum";
+  case SUBTRACTIVE:
+    return "subtractive";
+  case PHYSICAL_MODEL:
+    return "physical";
+  case FREQUENCY_MODULATION:
+    return "fm";
+  case SAMPLER:
+    return "sampler";
+  }
+  return "";
+}
+
+static inline const bool parseSynthType(const std::string &name,
+                                        SynthesizerType *synthType) {
+  for (auto candidate : SynthTypes) {
+    if (name == getScriptName(candidate)) {
+      *synthType = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline const bool
+parseParameterType(const std::string &name,
+                   ContinuousParameterType *parameterType) {
+  for (auto candidate : ParameterTypes) {
+    if (name == getScriptName(candidate)) {
+      *parameterType = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename sample_t>
+static inline const bool parseRenderScript(std::istream &input,
+                                           const sample_t sampleRate,
+                                           RenderScript<sample_t> *script,
+                                           std::string *error) {
+  std::string line;
+  size_t lineNumber = 0;
+  double lastEventTime = 0;
+  bool hasEnd = false;
+  while (std::getline(input, line)) {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    double time;
+    std::string command;
+    if (!(fields >> time)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+      *error = "line " + std::to_string(lineNumber) + ": expected a time";
+      return false;
+    }
+    if (!(fields >> command) || time < 0) {
+      *error = "line " + std::to_string(lineNumber) + ": expected a command";
+      return false;
+    }
+    const uint64_t frame = uint64_t(time * sampleRate + 0.5);
+    lastEventTime = std::max(lastEventTime, time);
+
+    if (command == "end") {
+      script->numFrames = frame;
+      hasEnd = true;
+    } else if (command == "engine") {
+      std::string name;
+      SynthesizerType synthType;
+      if (!(fields >> name) || !parseSynthType(name, &synthType)) {
+        *error = "line " + std::to_string(lineNumber) + ": unknown engine";
+        return false;
+      }
+      script->events.push_back(
+          {.frame = frame, .event = SynthesizerEvent<sample_t>(synthType)});
+    } else if (command == "param") {
+      std::string name;
+      sample_t value;
+      ContinuousParameterType parameterType;
+      if (!(fields >> name >> value) ||
+          !parseParameterType(name, &parameterType)) {
+        *error = "line " + std::to_string(lineNumber) + ": bad param";
+        return false;
+      }
+      script->events.push_back(
+          {.frame = frame,
+           .event = SynthesizerEvent<sample_t>(ParameterChangeEvent<sample_t>{
+               .type = parameterType, .value = value})});
+    } else if (command == "gate") {
+      sample_t value;
+      int voiceKey = 0;
+      if (!(fields >> value)) {
+        *error = "line " + std::to_string(lineNumber) + ": bad gate";
+        return false;
+      }
+      fields >> voiceKey;
+      script->events.push_back(
+          {.frame = frame,
+           .event = SynthesizerEvent<sample_t>(
+               GateEvent<sample_t>{.value = value, .voiceKey = voiceKey})});
+    } else if (command == "bend") {
+      sample_t note, destinationNote;
+      if (!(fields >> note >> destinationNote)) {
+        *error = "line " + std::to_string(lineNumber) + ": bad bend";
+        return false;
+      }
+      script->events.push_back(
+          {.frame = frame,
+           .event = SynthesizerEvent<sample_t>(PitchBendEvent<sample_t>{
+               .note = note, .destinationNote = destinationNote})});
+    } else {
+      *error = "line " + std::to_string(lineNumber) + ": unknown command " +
+               command;
+      return false;
+    }
+  }
+  if (!hasEnd) {
+    script->numFrames = uint64_t((lastEventTime + 1.0) * sampleRate);
+  }
+  std::stable_sort(script->events.begin(), script->events.end(),
+                   [](const ScriptedEvent<sample_t> &a,
+                      const ScriptedEvent<sample_t> &b) {
+                     return a.frame < b.frame;
+                   });
+  return true;
+}
+
+// Feeds the script to the synth block by block. Events are queued with their
+// exact frame so process() splits blocks on them, just like live input.
+template <typename sample_t>
+static inline void renderScript(Synthesizer<sample_t> *synth,
+                                const RenderScript<sample_t> &script,
+                                sample_t *output, const size_t blockSize) {
+  size_t nextEvent = 0;
+  while (synth->renderedFrames < script.numFrames) {
+    const uint64_t blockStart = synth->renderedFrames;
+    uint64_t blockEnd = std::min<uint64_t>(blockStart + blockSize,
+                                           script.numFrames);
+    while (nextEvent < script.events.size() &&
+           script.events[nextEvent].frame < blockEnd) {
+      const ScriptedEvent<sample_t> &scripted = script.events[nextEvent];
+      if (!synth->pushEventAt(scripted.event, scripted.frame)) {
+        // queue full: stop short of the event that did not fit
+        blockEnd = std::max(scripted.frame, blockStart);
+        break;
+      }
+      ++nextEvent;
+    }
+    if (blockEnd == blockStart) {
+      synth->consumeMessagesFromQueue(0);
+      continue;
+    }
+    synth->process(output + blockStart, size_t(blockEnd - blockStart));
+  }
+}
+
+// mono 32-bit float WAV
+template <typename sample_t>
+static inline const bool writeWAV(const std::string &path,
+                                  const sample_t *samples,
+                                  const size_t numFrames,
+                                  const uint32_t sampleRate) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  auto write32 = [&file](uint32_t value) {
+    const char bytes[4] = {char(value & 0xff), char((value >> 8) & 0xff),
+                           char((value >> 16) & 0xff),
+                           char((value >> 24) & 0xff)};
+    file.write(bytes, 4);
+  };
+  auto write16 = [&file](uint16_t value) {
+    const char bytes[2] = {char(value & 0xff), char((value >> 8) & 0xff)};
+    file.write(bytes, 2);
+  };
+  const uint32_t dataSize = uint32_t(numFrames * sizeof(float));
+  file.write("RIFF", 4);
+  write32(36 + dataSize);
+  file.write("WAVE", 4);
+  file.write("fmt ", 4);
+  write32(16);
+  write16(3); // IEEE float
+  write16(1);
+  write32(sampleRate);
+  write32(sampleRate * sizeof(float));
+  write16(sizeof(float));
+  write16(32);
+  file.write("data", 4);
+  write32(dataSize);
+  for (size_t i = 0; i < numFrames; ++i) {
+    const float sample = float(samples[i]);
+    uint32_t bits;
+    std::memcpy(&bits, &sample, sizeof(bits));
+    write32(bits);
+  }
+  return file.good();
+}
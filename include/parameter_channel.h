@@ -0,0 +1,57 @@
+#pragma once
+
+#include "synthesis_parameter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+static_assert(NUM_PARAMETER_TYPES <= 32,
+              "the dirty mask has one bit per parameter");
+
+// Latest-value handoff for continuous parameters, next to the event queue.
+// Every parameter has one slot holding its newest value and the frame it is
+// due at; send() overwrites the slot and sets the parameter's dirty bit, so
+// a burst of sensor updates costs the audio thread at most one value per
+// parameter per block and the sender never waits. receive() runs on the
+// audio thread only.
+//
+// The value and frame of a slot are separate atomics, so a receive that
+// races a send can pair the new value with the old frame. The frame only
+// places the change within a block, so that costs at most a block of timing.
+template <typename sample_t> struct ParameterChannel {
+  struct alignas(CACHE_LINE_SIZE) Slot {
+    std::atomic<sample_t> value = 0;
+    std::atomic<uint64_t> frame = 0;
+  };
+
+  Slot slots[NUM_PARAMETER_TYPES];
+  std::atomic<uint32_t> dirty = 0;
+  // sends that replaced a value the audio thread had not picked up yet
+  std::atomic<uint32_t> coalesced = 0;
+
+  inline void send(const ContinuousParameterType type, const sample_t value,
+                   const uint64_t frame) {
+    if (type >= NUM_PARAMETER_TYPES) {
+      return;
+    }
+    slots[type].value.store(value, std::memory_order_relaxed);
+    slots[type].frame.store(frame, std::memory_order_relaxed);
+    const uint32_t bit = uint32_t(1) << type;
+    if (dirty.fetch_or(bit, std::memory_order_release) & bit) {
+      coalesced.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // copies every parameter sent since the last call into values and frames
+  // and returns their bits
+  inline const uint32_t receive(sample_t *values, uint64_t *frames) {
+    const uint32_t changed = dirty.exchange(0, std::memory_order_acquire);
+    for (size_t i = 0; i < NUM_PARAMETER_TYPES; ++i) {
+      if (changed & (uint32_t(1) << i)) {
+        values[i] = slots[i].value.load(std::memory_order_relaxed);
+        frames[i] = slots[i].frame.load(std::memory_order_relaxed);
+      }
+    }
+    return changed;
+  }
+};
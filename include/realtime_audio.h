@@ -0,0 +1,238 @@
+#pragma once
+
+#include "SDL_log.h"
+#include "SDL_thread.h"
+#include "arena.h"
+#include "triple_buffer.h"
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Turns denormal floats into zero on the calling thread. Decaying feedback
+// loops such as the string model's delay lines and one-pole filters spend
+// many blocks in the denormal range, where every operation takes a slow
+// microcode path on x86 and traps to software on some ARM cores. On x86 this
+// sets FTZ and DAZ in MXCSR, on ARM the FZ bit, which covers both.
+static inline bool FlushDenormalsOnThisThread() {
+#if defined(__SSE__) || defined(_M_X64)
+  const unsigned int FLUSH_TO_ZERO = 0x8000;
+  const unsigned int DENORMALS_ARE_ZERO = 0x0040;
+  _mm_setcsr(_mm_getcsr() | FLUSH_TO_ZERO | DENORMALS_ARE_ZERO);
+  return true;
+#elif defined(__aarch64__)
+  uint64_t fpcr;
+  __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+  fpcr |= uint64_t(1) << 24;
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+  return true;
+#elif defined(__arm__) && defined(__ARM_FP)
+  uint32_t fpscr;
+  __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+  fpscr |= uint32_t(1) << 24;
+  __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+  return true;
+#else
+  return false;
+#endif
+}
+
+struct MemoryResidency {
+  size_t bytesLocked = 0;
+  size_t bytesPrefaulted = 0;
+
+  inline MemoryResidency &operator+=(const MemoryResidency &other) {
+    bytesLocked += other.bytesLocked;
+    bytesPrefaulted += other.bytesPrefaulted;
+    return *this;
+  }
+};
+
+static inline size_t SystemPageSize() {
+#ifdef _WIN32
+  return 4096;
+#else
+  const long systemPageSize = sysconf(_SC_PAGESIZE);
+  return systemPageSize > 0 ? size_t(systemPageSize) : 4096;
+#endif
+}
+
+// Makes every chunk the arena has reserved resident before the audio thread
+// needs it. Each chunk is mlock'ed, which also faults it in; where that is
+// not allowed (RLIMIT_MEMLOCK is small on most desktops) every page is
+// touched instead, which helps until the OS reclaims them. Touching writes
+// each byte back unchanged, so nothing else may be writing to the arena.
+static inline MemoryResidency MakeArenaResident(const Arena &arena) {
+  MemoryResidency residency;
+  const size_t pageSize = SystemPageSize();
+  arena.forEachChunk([&residency, pageSize](char *data, const size_t size) {
+#ifndef _WIN32
+    if (mlock(data, size) == 0) {
+      residency.bytesLocked += size;
+      return;
+    }
+#endif
+    volatile char *bytes = data;
+    for (size_t i = 0; i < size; i += pageSize) {
+      bytes[i] = bytes[i];
+    }
+    residency.bytesPrefaulted += size;
+  });
+  return residency;
+}
+
+// The same for memory that already holds data and that the audio thread only
+// reads, such as a mapped sample pack. Without mlock the kernel is asked to
+// read the region ahead and one byte per page is read, which faults file
+// pages and swapped-out pages back in. Nothing is written, so others may
+// keep writing to the region.
+static inline MemoryResidency MakeRegionResident(const void *data,
+                                                 const size_t size) {
+  MemoryResidency residency;
+  if (data == NULL || size == 0) {
+    return residency;
+  }
+  const size_t pageSize = SystemPageSize();
+#ifndef _WIN32
+  if (mlock(data, size) == 0) {
+    residency.bytesLocked = size;
+    return residency;
+  }
+  // madvise wants a page-aligned start
+  const uintptr_t start = uintptr_t(data) & ~uintptr_t(pageSize - 1);
+  madvise((void *)start, size + (uintptr_t(data) - start), MADV_WILLNEED);
+#endif
+  volatile const char *bytes = (const char *)data;
+  char sink = 0;
+  for (size_t i = 0; i < size; i += pageSize) {
+    sink ^= bytes[i];
+  }
+  (void)sink;
+  residency.bytesPrefaulted = size;
+  return residency;
+}
+
+// On big.LITTLE parts, the core with the highest maximum clock; -1 where
+// every core is the same or the clocks cannot be read, in which case the
+// scheduler is left to place the audio thread.
+static inline int FindFastestCore() {
+#ifdef __linux__
+  const long numCores = sysconf(_SC_NPROCESSORS_CONF);
+  int fastest = -1;
+  long fastestFrequency = 0;
+  long slowestFrequency = LONG_MAX;
+  for (long core = 0; core < numCores && core < CPU_SETSIZE; ++core) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%ld/cpufreq/cpuinfo_max_freq", core);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+      continue;
+    }
+    long frequency = 0;
+    const bool read = fscanf(file, "%ld", &frequency) == 1;
+    fclose(file);
+    if (!read) {
+      continue;
+    }
+    if (frequency > fastestFrequency) {
+      fastestFrequency = frequency;
+      fastest = int(core);
+    }
+    slowestFrequency =
+        frequency < slowestFrequency ? frequency : slowestFrequency;
+  }
+  return fastestFrequency > slowestFrequency ? fastest : -1;
+#else
+  return -1;
+#endif
+}
+
+struct RealtimeThreadReport {
+  // how many times the setup has run, so the UI can tell a new report apart
+  uint32_t applications = 0;
+  bool denormalsFlushed = false;
+  bool priorityRaised = false;
+  // -1 if the thread was not pinned
+  int pinnedCore = -1;
+};
+
+// Per-thread realtime setup for the audio callback. SDL owns the audio
+// thread, so the setup runs from inside the callback: on the first one, and
+// again after requestSetup(), as a resumed device is not guaranteed to call
+// back on the same thread. Every step is best effort; what worked is
+// published for the UI thread to log, because logging is not safe on the
+// audio thread.
+struct RealtimeAudioThread {
+  // set on the UI thread before the device starts; -1 leaves affinity alone
+  int preferredCore = -1;
+  std::atomic<bool> pending = true;
+  RealtimeThreadReport report;
+  TripleBuffer<RealtimeThreadReport> published;
+  // UI thread state
+  uint32_t loggedApplications = 0;
+
+  // audio thread, at the top of every callback. The first call after a
+  // request makes a few system calls, and raising the priority may have to
+  // ask a system service, so that one callback can run long.
+  inline void setupIfPending() {
+    if (!pending.load(std::memory_order_acquire)) {
+      return;
+    }
+    pending.store(false, std::memory_order_relaxed);
+    report.denormalsFlushed = FlushDenormalsOnThisThread();
+    report.priorityRaised =
+        SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL) == 0;
+    report.pinnedCore = -1;
+#ifdef __linux__
+    if (preferredCore >= 0) {
+      cpu_set_t cores;
+      CPU_ZERO(&cores);
+      CPU_SET(preferredCore, &cores);
+      if (sched_setaffinity(0, sizeof(cores), &cores) == 0) {
+        report.pinnedCore = preferredCore;
+      }
+    }
+#endif
+    ++report.applications;
+    published.writeBuffer() = report;
+    published.publish();
+  }
+
+  // UI thread, before the device is resumed
+  inline void requestSetup() {
+    pending.store(true, std::memory_order_release);
+  }
+
+  // UI thread; logs each report once
+  inline void logReport() {
+    const RealtimeThreadReport &latest = published.latest();
+    if (latest.applications == loggedApplications) {
+      return;
+    }
+    loggedApplications = latest.applications;
+    char core[32] = "any core";
+    if (latest.pinnedCore >= 0) {
+      snprintf(core, sizeof(core), "core %d", latest.pinnedCore);
+    }
+    SDL_Log("audio thread: denormals %s, priority %s, running on %s",
+            latest.denormalsFlushed ? "flushed" : "not flushed",
+            latest.priorityRaised ? "time critical" : "unchanged", core);
+    if (preferredCore >= 0 && latest.pinnedCore < 0) {
+      SDL_LogWarn(0, "audio thread: could not pin to core %d",
+                  preferredCore);
+    }
+  }
+};
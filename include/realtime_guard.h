@@ -0,0 +1,245 @@
+#pragma once
+
+// Debug build mode that catches realtime-safety regressions on the audio
+// thread. Configure with -DREALTIME_GUARD=ON and every malloc, free and
+// pthread mutex lock made while a RealtimeGuard::Scope is alive on the
+// calling thread is recorded with a backtrace in a lock-free ring. The UI
+// loop drains the ring with logViolations(). operator new and delete go
+// through malloc and free, so they are caught too.
+//
+// The interposers are defined in this header, so it may only be included
+// from one translation unit. They forward to glibc's internal entry points;
+// on other C libraries only operator new and delete are replaced and mutex
+// locks are not seen.
+//
+// Without REALTIME_GUARD, Scope and logViolations() compile to nothing.
+
+#include "SDL_log.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef REALTIME_GUARD
+#include <cerrno>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <new>
+#include <pthread.h>
+#include <unwind.h>
+#endif
+
+struct RealtimeGuard {
+  enum ViolationKind { ALLOCATION, DEALLOCATION, MUTEX_LOCK };
+
+#ifdef REALTIME_GUARD
+  static constexpr size_t MAX_FRAMES = 24;
+  // a power of two
+  static constexpr uint32_t RING_SIZE = 64;
+
+  struct Violation {
+    ViolationKind kind;
+    uint32_t numFrames;
+    void *frames[MAX_FRAMES];
+  };
+
+  // plain thread_locals, so touching them never allocates
+  static inline thread_local int scopeDepth = 0;
+  static inline thread_local bool recording = false;
+
+  // written by the audio thread, drained by the UI thread
+  static inline Violation ring[RING_SIZE];
+  static inline std::atomic<uint32_t> head = 0;
+  static inline std::atomic<uint32_t> tail = 0;
+  static inline std::atomic<uint32_t> dropped = 0;
+
+  struct Scope {
+    Scope() { ++scopeDepth; }
+    ~Scope() { --scopeDepth; }
+  };
+
+  struct Trace {
+    void **frames;
+    uint32_t numFrames;
+  };
+
+  static _Unwind_Reason_Code traceFrame(_Unwind_Context *context,
+                                        void *argument) {
+    Trace *trace = (Trace *)argument;
+    if (trace->numFrames >= MAX_FRAMES) {
+      return _URC_END_OF_STACK;
+    }
+    const uintptr_t address = _Unwind_GetIP(context);
+    if (address != 0) {
+      trace->frames[trace->numFrames++] = (void *)address;
+    }
+    return _URC_NO_REASON;
+  }
+
+  static inline void check(const ViolationKind kind) {
+    if (scopeDepth == 0 || recording) {
+      return;
+    }
+    recording = true;
+    const uint32_t write = head.load(std::memory_order_relaxed);
+    if (write - tail.load(std::memory_order_acquire) >= RING_SIZE) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      Violation &violation = ring[write & (RING_SIZE - 1)];
+      violation.kind = kind;
+      Trace trace = {violation.frames, 0};
+      _Unwind_Backtrace(traceFrame, &trace);
+      violation.numFrames = trace.numFrames;
+      head.store(write + 1, std::memory_order_release);
+    }
+    recording = false;
+  }
+
+  // the unwinder loads its tables on first use, which allocates, so it
+  // runs once at startup rather than on the first violation
+  static inline bool primeUnwinder() {
+    void *frames[MAX_FRAMES];
+    Trace trace = {frames, 0};
+    _Unwind_Backtrace(traceFrame, &trace);
+    return trace.numFrames > 0;
+  }
+  static inline const bool primed = primeUnwinder();
+
+  // glibc has no internal name for pthread_mutex_lock that can be linked
+  // against, so the real one is looked up. Threads racing here all store
+  // the same pointer.
+  typedef int (*MutexLockFunction)(pthread_mutex_t *);
+  static inline std::atomic<MutexLockFunction> mutexLock = nullptr;
+  static inline MutexLockFunction nextMutexLock() {
+    MutexLockFunction function = mutexLock.load(std::memory_order_acquire);
+    if (function == nullptr) {
+      function = (MutexLockFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+      mutexLock.store(function, std::memory_order_release);
+    }
+    return function;
+  }
+  static inline const bool resolved = nextMutexLock() != nullptr;
+
+  static inline const char *kindName(const ViolationKind kind) {
+    switch (kind) {
+    case ALLOCATION:
+      return "allocation";
+    case DEALLOCATION:
+      return "deallocation";
+    case MUTEX_LOCK:
+      return "mutex lock";
+    }
+    return "";
+  }
+
+  // UI thread
+  static void logViolations() {
+    const uint32_t read = tail.load(std::memory_order_relaxed);
+    const uint32_t end = head.load(std::memory_order_acquire);
+    for (uint32_t i = read; i != end; ++i) {
+      const Violation &violation = ring[i & (RING_SIZE - 1)];
+      SDL_LogError(0, "realtime guard: %s on the audio thread",
+                   kindName(violation.kind));
+      for (uint32_t frame = 0; frame < violation.numFrames; ++frame) {
+        logFrame(frame, violation.frames[frame]);
+      }
+    }
+    tail.store(end, std::memory_order_release);
+    const uint32_t numDropped = dropped.exchange(0, std::memory_order_relaxed);
+    if (numDropped > 0) {
+      SDL_LogError(0, "realtime guard: %u more violations were dropped",
+                   numDropped);
+    }
+  }
+
+  static void logFrame(const uint32_t index, void *address) {
+    Dl_info info;
+    if (dladdr(address, &info) == 0 || info.dli_sname == NULL) {
+      SDL_LogError(0, "  #%u %p %s", index, address,
+                   info.dli_fname != NULL ? info.dli_fname : "");
+      return;
+    }
+    int status = 0;
+    char *demangled =
+        abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    SDL_LogError(0, "  #%u %s+0x%zx", index,
+                 status == 0 ? demangled : info.dli_sname,
+                 size_t((char *)address - (char *)info.dli_saddr));
+    free(demangled);
+  }
+#else
+  struct Scope {};
+  static inline void logViolations() {}
+#endif
+};
+
+#ifdef REALTIME_GUARD
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  return __libc_calloc(count, size);
+}
+void *realloc(void *pointer, size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  return __libc_realloc(pointer, size);
+}
+void *memalign(size_t alignment, size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  return __libc_memalign(alignment, size);
+}
+void *aligned_alloc(size_t alignment, size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  return __libc_memalign(alignment, size);
+}
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  *pointer = __libc_memalign(alignment, size);
+  return *pointer == NULL ? ENOMEM : 0;
+}
+void free(void *pointer) {
+  if (pointer != NULL) {
+    RealtimeGuard::check(RealtimeGuard::DEALLOCATION);
+  }
+  __libc_free(pointer);
+}
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  RealtimeGuard::check(RealtimeGuard::MUTEX_LOCK);
+  return RealtimeGuard::nextMutexLock()(mutex);
+}
+}
+#else
+void *operator new(size_t size) {
+  RealtimeGuard::check(RealtimeGuard::ALLOCATION);
+  void *pointer = malloc(size);
+  if (pointer == NULL) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pointer) noexcept {
+  if (pointer != NULL) {
+    RealtimeGuard::check(RealtimeGuard::DEALLOCATION);
+  }
+  free(pointer);
+}
+void operator delete[](void *pointer) noexcept { operator delete(pointer); }
+void operator delete(void *pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+void operator delete[](void *pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+#endif
+#endif
@@ -1,30 +1,311 @@
 #pragma once
 
+#include "SDL_log.h"
+#include "SDL_rwops.h"
 #include "arena.h"
 #include "sample_buffer.h"
 #include "sample_load.h"
+#include "sample_pack.h"
+#include "sample_resample.h"
+#include "sample_stream.h"
+#include "sample_waveform.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <vector>
 template <typename sample_t> struct SampleBank {
   static constexpr size_t MAX_BANK_SIZE = 16;
+  // with a streamer attached, files longer than this keep only their first
+  // STREAM_HEAD_SECONDS in the arena and play the rest from disk
+  static constexpr double STREAM_THRESHOLD_SECONDS = 4;
+  static constexpr double STREAM_HEAD_SECONDS = 0.5;
   Arena *arena = NULL;
+  // every buffer is converted to this rate as it is loaded, so the sampler
+  // can read all of them at one increment; set it before loading starts
+  sample_t sampleRate = 48000;
+  // how loaded buffers are kept in the arena; mapped and streamed samples
+  // stay float
+  SampleEncoding encoding = DEFAULT_SAMPLE_ENCODING;
   SampleBuffer<sample_t> *buffers[MAX_BANK_SIZE];
-  size_t size = 0;
+  StreamedSample<sample_t> *streamed[MAX_BANK_SIZE] = {};
+  // thumbnails for the UI, so it never reads the audio data; NULL if the
+  // arena had no room for one
+  WaveformPyramid *waveforms[MAX_BANK_SIZE] = {};
+  SampleStreamer<sample_t> *streamer = NULL;
+  // entries below size are complete and never change while the bank is in
+  // use, so a loader thread can keep appending while the audio thread plays
+  // what is already there; read it once per block with acquire
+  std::atomic<size_t> size = 0;
+  // set by SampleLibrary when the bank is published
+  uint64_t generation = 0;
   SampleBank(Arena *sampleArena) : arena(sampleArena) {}
+  // not safe while the bank is being played or loaded
   void clear() {
-    buffers.clear();
+    const size_t numEntries = size.load();
+    for (size_t i = 0; i < numEntries; ++i) {
+      buffers[i] = NULL;
+      streamed[i] = NULL;
+      waveforms[i] = NULL;
+    }
     arena->clear();
-    size = 0;
+    size.store(0);
+  }
+  // single writer: whoever loads the bank
+  inline void publish(SampleBuffer<sample_t> *buffer,
+                      StreamedSample<sample_t> *streamedSample,
+                      WaveformPyramid *waveform = NULL) {
+    const size_t index = size.load(std::memory_order_relaxed);
+    buffers[index] = buffer;
+    streamed[index] = streamedSample;
+    waveforms[index] = waveform;
+    size.store(index + 1, std::memory_order_release);
   }
   bool loadSample(const std::string &path) {
-    if (size == MAX_BANK_SIZE)
+    if (size.load(std::memory_order_relaxed) == MAX_BANK_SIZE)
       return false;
+    if (streamer != NULL && loadStreamedSample(path))
+      return true;
+    const Arena::Marker marker = arena->mark();
     auto sampleBuffer = LoadWAVSampleAsMono(arena, path);
+    if (sampleBuffer != NULL) {
+      sampleBuffer = convertToBankRate(sampleBuffer, marker);
+    }
+    if (sampleBuffer != NULL) {
+      sampleBuffer = encode(sampleBuffer, marker);
+    }
     if (sampleBuffer != NULL) {
       SDL_Log("Sample load %s", path.c_str());
-      buffers[size++] = sampleBuffer;
+      publish(sampleBuffer, NULL, buildWaveform(sampleBuffer));
       return true;
     } else {
       return false;
     }
   }
+
+  // Starts a thumbnail of numFrames frames in the arena, or returns NULL.
+  WaveformPyramid *pushWaveform(const size_t numFrames) {
+    if (!arena->canAlloc<WaveformPyramid>()) {
+      return NULL;
+    }
+    const Arena::Marker marker = arena->mark();
+    auto waveform = new (arena->push<WaveformPyramid>()) WaveformPyramid();
+    if (!waveform->allocate(arena, numFrames)) {
+      arena->reset(marker);
+      return NULL;
+    }
+    return waveform;
+  }
+
+  // a thumbnail over the peaks the pack stores for entry index
+  WaveformPyramid *mapWaveform(const MappedSamplePack &pack,
+                               const size_t index) {
+    if (!arena->canAlloc<WaveformPyramid>()) {
+      return NULL;
+    }
+    auto waveform = new (arena->push<WaveformPyramid>()) WaveformPyramid();
+    // the mapping is read-only, and nothing writes to a built pyramid
+    waveform->attach(const_cast<WaveformPyramid::Peak *>(
+                         pack.waveformPeaks(index)),
+                     size_t(pack.entries[index].numFrames));
+    return waveform;
+  }
+
+  WaveformPyramid *buildWaveform(const SampleBuffer<sample_t> *buffer) {
+    WaveformPyramid *waveform = pushWaveform(buffer->bufferSize);
+    if (waveform == NULL) {
+      return NULL;
+    }
+    alignas(Arena::CACHE_LINE) sample_t frames[1024];
+    for (size_t start = 0; start < buffer->bufferSize; start += 1024) {
+      const size_t count = buffer->bufferSize - start < 1024
+                               ? buffer->bufferSize - start
+                               : 1024;
+      buffer->decode(start, count, frames);
+      waveform->add(frames, count);
+    }
+    waveform->finish();
+    return waveform;
+  }
+
+  // Replaces buffer, the last thing pushed after marker, with a copy at the
+  // bank rate. Returns NULL if the converted copy does not fit.
+  SampleBuffer<sample_t> *convertToBankRate(SampleBuffer<sample_t> *buffer,
+                                            const Arena::Marker &marker) {
+    if (buffer->sampleRate == sampleRate) {
+      return buffer;
+    }
+    PolyphaseResampler<sample_t> resampler(double(buffer->sampleRate),
+                                           double(sampleRate));
+    std::vector<sample_t> converted(
+        resampler.outputLength(buffer->bufferSize));
+    resampler.process(buffer->buffer, buffer->bufferSize, converted.data(),
+                      converted.size());
+    SDL_Log("Sample resampled from %dHz to %dHz", int(buffer->sampleRate),
+            int(sampleRate));
+    const size_t numChannels = buffer->numChannels;
+    arena->reset(marker);
+    if (!arena->canAllocArray<sample_t>(converted.size() +
+                                        2 * Arena::CACHE_LINE)) {
+      SDL_LogError(0, "sample arena is full!");
+      return NULL;
+    }
+    auto resampled = new (arena->push<SampleBuffer<sample_t>>())
+        SampleBuffer<sample_t>(arena, sampleRate, converted.size(),
+                               numChannels);
+    std::memcpy(resampled->buffer, converted.data(),
+                converted.size() * sizeof(sample_t));
+    return resampled;
+  }
+
+  // Replaces a float buffer, the last thing pushed after marker, with one in
+  // the bank's encoding. INT16 is scaled to the buffer's peak when that is
+  // above 1, so resampling overshoot does not clip.
+  SampleBuffer<sample_t> *encode(SampleBuffer<sample_t> *buffer,
+                                 const Arena::Marker &marker) {
+    if (encoding == SAMPLE_FLOAT || buffer->encoding == encoding) {
+      return buffer;
+    }
+    sample_t peak = 1;
+    for (size_t i = 0; i < buffer->bufferSize; ++i) {
+      const sample_t magnitude = fabs(buffer->buffer[i]);
+      peak = magnitude > peak ? magnitude : peak;
+    }
+    const sample_t scale = peak / sample_t(INT16_MAX);
+    std::vector<int16_t> pcm(buffer->bufferSize);
+    for (size_t i = 0; i < pcm.size(); ++i) {
+      pcm[i] = int16_t(lrint(buffer->buffer[i] / scale));
+    }
+    const sample_t bufferSampleRate = buffer->sampleRate;
+    const size_t numChannels = buffer->numChannels;
+    arena->reset(marker);
+    if (!arena->canAllocArray<int16_t>(pcm.size() + 2 * Arena::CACHE_LINE)) {
+      SDL_LogError(0, "sample arena is full!");
+      return NULL;
+    }
+    auto encoded = new (arena->push<SampleBuffer<sample_t>>())
+        SampleBuffer<sample_t>(arena, bufferSampleRate, pcm.size(),
+                               numChannels, scale);
+    std::memcpy(encoded->pcm16, pcm.data(), pcm.size() * sizeof(int16_t));
+    return encoded;
+  }
+
+  // Adds every sample in the pack, without copying those already at the bank
+  // rate; the pack has to stay open for as long as the bank is played. Only
+  // float banks can use packs.
+  size_t loadSamplePack(const MappedSamplePack &pack) {
+    size_t numLoaded = 0;
+    for (size_t i = 0; i < pack.numEntries(); ++i) {
+      if (size.load(std::memory_order_relaxed) == MAX_BANK_SIZE ||
+          !arena->canAlloc<SampleBuffer<sample_t>>())
+        break;
+      const SamplePackEntry &entry = pack.entries[i];
+      const Arena::Marker marker = arena->mark();
+      auto sampleBuffer = new (arena->push<SampleBuffer<sample_t>>())
+          SampleBuffer<sample_t>((sample_t *)pack.frames(i),
+                                 sample_t(entry.sampleRate),
+                                 size_t(entry.numFrames), 1);
+      // entries at another rate are copied, converted, into the arena
+      sampleBuffer = convertToBankRate(sampleBuffer, marker);
+      if (sampleBuffer == NULL)
+        break;
+      const bool mapped = sampleBuffer->buffer == pack.frames(i);
+      if (!mapped) {
+        sampleBuffer = encode(sampleBuffer, marker);
+        if (sampleBuffer == NULL)
+          break;
+      }
+      SDL_Log("Sample map %s (%.1fs, peak %.2f)", entry.name,
+              double(entry.numFrames) / double(entry.sampleRate),
+              double(entry.peak));
+      // a mapped entry uses the peaks stored with it, so the thumbnail does
+      // not page in its audio
+      publish(sampleBuffer, NULL,
+              mapped ? mapWaveform(pack, i) : buildWaveform(sampleBuffer));
+      ++numLoaded;
+    }
+    return numLoaded;
+  }
+
+  // false means the file is short, unreadable or not a format the streamer
+  // decodes, and should go through the in-memory path instead
+  bool loadStreamedSample(const std::string &path) {
+    if (path.size() >= StreamedSample<sample_t>::MAX_PATH_LENGTH)
+      return false;
+    SDL_RWops *file = SDL_RWFromFile(path.c_str(), "rb");
+    if (file == NULL)
+      return false;
+    WAVFormat format;
+    if (!ReadWAVFormat(file, &format) ||
+        double(format.numFrames) <=
+            STREAM_THRESHOLD_SECONDS * double(format.sampleRate)) {
+      SDL_RWclose(file);
+      return false;
+    }
+    StreamedSample<sample_t> description;
+    description.format = format;
+    description.sampleRate = uint32_t(sampleRate);
+    std::unique_ptr<PolyphaseResampler<sample_t>> resampler;
+    if (description.needsResampling()) {
+      resampler.reset(new PolyphaseResampler<sample_t>(
+          double(format.sampleRate), double(sampleRate)));
+      resampler->seek(0);
+    }
+    description.numFrames =
+        resampler != NULL ? resampler->outputLength(format.numFrames)
+                          : format.numFrames;
+    description.headFrames = size_t(STREAM_HEAD_SECONDS * double(sampleRate));
+    std::strncpy(description.path, path.c_str(),
+                 StreamedSample<sample_t>::MAX_PATH_LENGTH - 1);
+    const size_t headFrames = description.headFrames;
+    if (!arena->canAllocArray<sample_t>(headFrames + 2 * Arena::CACHE_LINE)) {
+      SDL_RWclose(file);
+      return false;
+    }
+
+    const Arena::Marker marker = arena->mark();
+    auto head = new (arena->push<SampleBuffer<sample_t>>())
+        SampleBuffer<sample_t>(arena, sampleRate, headFrames, 1);
+    auto streamedSample = new (arena->push<StreamedSample<sample_t>>())
+        StreamedSample<sample_t>(description);
+    WaveformPyramid *waveform = pushWaveform(size_t(description.numFrames));
+
+    // the head and the thumbnail both come from one pass over the file, at
+    // the bank rate like the streamer will play it; the rest of the audio
+    // data is not kept
+    const size_t CHUNK_FRAMES = 4096;
+    std::vector<uint8_t> chunkBytes;
+    std::vector<sample_t> chunkInput;
+    std::vector<sample_t> chunkFrames(CHUNK_FRAMES);
+    uint64_t frame = 0;
+    while (frame < description.numFrames) {
+      const size_t count = ReadStreamedFrames<sample_t>(
+          file, description, resampler.get(), frame, CHUNK_FRAMES, chunkBytes,
+          chunkInput, chunkFrames.data());
+      if (count == 0) {
+        break;
+      }
+      for (size_t i = 0; i < count && frame + i < headFrames; ++i) {
+        head->buffer[frame + i] = chunkFrames[i];
+      }
+      if (waveform != NULL) {
+        waveform->add(chunkFrames.data(), count);
+      }
+      frame += count;
+    }
+    SDL_RWclose(file);
+    if (frame < headFrames) {
+      arena->reset(marker);
+      return false;
+    }
+    if (waveform != NULL) {
+      waveform->finish();
+    }
+    SDL_Log("Sample stream %s (%.1fs)", path.c_str(),
+            double(format.numFrames) / double(format.sampleRate));
+    publish(head, streamedSample, waveform);
+    return true;
+  }
 };
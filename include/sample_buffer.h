@@ -1,23 +1,86 @@
 #pragma once
 
 #include "arena.h"
+#include "simd.h"
+#include <algae.h>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+using algae::dsp::math::lerp;
+
+// How a buffer keeps its frames in memory. INT16 takes half the space and
+// bandwidth of FLOAT and is lossless for 16-bit sources; readers decode it
+// with decode() or frame().
+enum SampleEncoding { SAMPLE_FLOAT, SAMPLE_INT16 };
+
+static constexpr SampleEncoding DEFAULT_SAMPLE_ENCODING = SAMPLE_INT16;
+
 template <typename sample_t> struct SampleBuffer {
   sample_t sampleRate;
   size_t numChannels;
+  // float frames; NULL for INT16 buffers
   sample_t *buffer;
   size_t bufferSize;
+  SampleEncoding encoding = SAMPLE_FLOAT;
+  // INT16 frames, each worth pcm16[i] * pcm16Scale
+  int16_t *pcm16 = NULL;
+  sample_t pcm16Scale = 0;
   SampleBuffer(Arena *arena, const sample_t _sampleRate,
                const size_t _bufferSize, const size_t _numChannels)
       : sampleRate(_sampleRate), bufferSize(_bufferSize),
         numChannels(_numChannels),
         buffer(arena->pushArray<sample_t>(_bufferSize)) {}
+  // wraps frames owned elsewhere, such as a mapped sample pack
+  SampleBuffer(sample_t *frames, const sample_t _sampleRate,
+               const size_t _bufferSize, const size_t _numChannels)
+      : sampleRate(_sampleRate), numChannels(_numChannels), buffer(frames),
+        bufferSize(_bufferSize) {}
+  // INT16 storage; the caller fills pcm16
+  SampleBuffer(Arena *arena, const sample_t _sampleRate,
+               const size_t _bufferSize, const size_t _numChannels,
+               const sample_t _pcm16Scale)
+      : sampleRate(_sampleRate), numChannels(_numChannels), buffer(NULL),
+        bufferSize(_bufferSize), encoding(SAMPLE_INT16),
+        pcm16(arena->pushArray<int16_t>(_bufferSize)),
+        pcm16Scale(_pcm16Scale) {}
+
+  inline const sample_t frame(const size_t index) const {
+    return encoding == SAMPLE_INT16 ? sample_t(pcm16[index]) * pcm16Scale
+                                    : buffer[index];
+  }
+
+  // Frames [start, start + count) as float. The INT16 conversion runs
+  // simd::LANES frames at a time; output has to be aligned to
+  // simd::ALIGNMENT.
+  inline void decode(const size_t start, const size_t count,
+                     sample_t *output) const {
+    size_t i = 0;
+    if (encoding == SAMPLE_INT16) {
+      if constexpr (std::is_same<sample_t, float>::value) {
+        const simd::vfloat scale = simd::broadcast(pcm16Scale);
+        for (; i + simd::LANES <= count; i += simd::LANES) {
+          simd::store(output + i,
+                      simd::loadInt16(pcm16 + start + i) * scale);
+        }
+      }
+      for (; i < count; ++i) {
+        output[i] = sample_t(pcm16[start + i]) * pcm16Scale;
+      }
+      return;
+    }
+    for (; i < count; ++i) {
+      output[i] = buffer[start + i];
+    }
+  }
+
   inline sample_t read(float phase) {
     sample_t readPosition = phase * (bufferSize - 1);
-    int r1 = floor(readPosition);
-    int r2 = (r1 + 1) % bufferSize;
+    size_t r1 = size_t(readPosition);
+    size_t r2 = r1 + 1 < bufferSize ? r1 + 1 : 0;
     sample_t mantissa = readPosition - sample_t(r1);
 
-    return lerp(buffer[r1], buffer[r2], mantissa);
+    return lerp(frame(r1), frame(r2), mantissa);
   }
 };
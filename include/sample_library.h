@@ -0,0 +1,164 @@
+#pragma once
+
+#include "SDL_log.h"
+#include "arena.h"
+#include "sample_bank.h"
+#include "sample_pack.h"
+#include "sample_stream.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// A bank together with everything it points into, so a retired kit is freed
+// in one go.
+template <typename sample_t> struct SampleKit {
+  Arena arena;
+  MappedSamplePack pack;
+  SampleBank<sample_t> bank;
+  // set by the loader once nothing more is appended or mapped
+  std::atomic<bool> loaded = false;
+
+  SampleKit(const size_t arenaChunkSize, const size_t arenaMaxSize)
+      : arena(arenaChunkSize, arenaMaxSize), bank(&arena) {}
+};
+
+// Hands sample kits to the audio thread RCU-style. A loader fills a kit off
+// the audio thread and publish() swaps it in with one atomic store; voices
+// pick up the current bank when a note starts and keep it until their next
+// note, so a kit change never switches samples under a sounding note.
+//
+// Each published bank gets a generation. After every block the audio thread
+// reports the oldest generation it can still reach: the oldest bank a
+// sounding voice holds, or the current one. A retired kit is freed by
+// collect() once that report has moved past it. Until the audio thread has
+// reported at all, nothing is freed.
+//
+// Only one audio thread may read a library. publish() and collect() lock, so
+// any number of non-realtime threads may call them.
+template <typename sample_t> struct SampleLibrary {
+  // every kit converts its samples to this rate
+  sample_t sampleRate = 48000;
+  size_t arenaChunkSize = 0;
+  size_t arenaMaxSize = SIZE_MAX;
+  SampleStreamer<sample_t> *streamer = NULL;
+
+  std::atomic<SampleKit<sample_t> *> current = NULL;
+  std::atomic<uint64_t> oldestGenerationInUse = 0;
+
+  std::mutex writerMutex;
+  std::vector<SampleKit<sample_t> *> retired;
+  uint64_t nextGeneration = 0;
+
+  SampleLibrary(const size_t _arenaChunkSize,
+                const size_t _arenaMaxSize = SIZE_MAX)
+      : arenaChunkSize(_arenaChunkSize), arenaMaxSize(_arenaMaxSize) {}
+
+  SampleLibrary(const SampleLibrary &) = delete;
+  SampleLibrary &operator=(const SampleLibrary &) = delete;
+
+  // the audio thread has to be stopped by now
+  ~SampleLibrary() {
+    for (auto kit : retired) {
+      release(kit);
+    }
+    release(current.load());
+  }
+
+  // an empty kit set up for this library; fill it, then publish it
+  SampleKit<sample_t> *createKit() {
+    auto kit = new SampleKit<sample_t>(arenaChunkSize, arenaMaxSize);
+    kit->bank.sampleRate = sampleRate;
+    kit->bank.streamer = streamer;
+    return kit;
+  }
+
+  // Makes kit the one new notes play from and takes ownership of it. A kit
+  // may still be appended to after it is published, as long as only one
+  // thread does so.
+  void publish(SampleKit<sample_t> *kit) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    kit->bank.generation = ++nextGeneration;
+    SampleKit<sample_t> *previous =
+        current.exchange(kit, std::memory_order_acq_rel);
+    if (previous != NULL) {
+      retired.push_back(previous);
+    }
+    collectLocked();
+  }
+
+  // frees the retired kits no voice can reach any more; returns how many
+  size_t collect() {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    return collectLocked();
+  }
+
+  // Visits every kit the audio thread may still read: the current one and
+  // the retired ones not yet collected. None is freed during the visit.
+  template <typename F> void forEachKit(F visit) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    SampleKit<sample_t> *kit = current.load(std::memory_order_acquire);
+    if (kit != NULL) {
+      visit(kit);
+    }
+    for (auto retiredKit : retired) {
+      visit(retiredKit);
+    }
+  }
+
+  inline bool hasKit() const {
+    return current.load(std::memory_order_acquire) != NULL;
+  }
+
+  // audio thread
+  inline SampleBank<sample_t> *acquire() const {
+    SampleKit<sample_t> *kit = current.load(std::memory_order_acquire);
+    return kit != NULL ? &kit->bank : NULL;
+  }
+
+  // audio thread, once per block, after everything it rendered
+  inline uint64_t currentGeneration() const {
+    SampleKit<sample_t> *kit = current.load(std::memory_order_acquire);
+    return kit != NULL ? kit->bank.generation : 0;
+  }
+  inline void reportOldestInUse(const uint64_t generation) {
+    oldestGenerationInUse.store(generation, std::memory_order_release);
+  }
+
+private:
+  size_t collectLocked() {
+    const uint64_t oldest =
+        oldestGenerationInUse.load(std::memory_order_acquire);
+    size_t numFreed = 0;
+    for (size_t i = 0; i < retired.size();) {
+      if (retired[i]->bank.generation < oldest) {
+        release(retired[i]);
+        retired[i] = retired.back();
+        retired.pop_back();
+        ++numFreed;
+      } else {
+        ++i;
+      }
+    }
+    if (numFreed > 0) {
+      SDL_Log("freed %d retired sample kits", int(numFreed));
+    }
+    return numFreed;
+  }
+
+  void release(SampleKit<sample_t> *kit) {
+    if (kit == NULL) {
+      return;
+    }
+    if (streamer != NULL) {
+      const size_t numEntries = kit->bank.size.load();
+      for (size_t i = 0; i < numEntries; ++i) {
+        if (kit->bank.streamed[i] != NULL) {
+          streamer->forget(kit->bank.streamed[i]);
+        }
+      }
+    }
+    delete kit;
+  }
+};
@@ -3,6 +3,7 @@
 #include "SDL_audio.h"
 #include "SDL_log.h"
 #include "sample_buffer.h"
+#include <limits>
 #include <string>
 static inline SampleBuffer<float> *
 LoadWAVSampleAsMono(Arena *arena, const std::string &samplePath) {
@@ -37,12 +38,16 @@ LoadWAVSampleAsMono(Arena *arena, const std::string &samplePath) {
             float(wavLength / float(bytesPerSample * wavSpec.channels)) /
                 float(wavSpec.freq));
     bufferSize = wavLength / bytesPerSample;
+    if (!arena->canAllocArray<float>(bufferSize)) {
+      SDL_LogError(0, "sample arena is full!");
+      free(wavBuffer);
+      return NULL;
+    }
     sampleInfo = new (arena->push<SampleBuffer<float>>())
         SampleBuffer<float>(arena, wavSpec.freq, bufferSize, wavSpec.channels);
-    if (sampleInfo == NULL) {
-      SDL_LogError(0, "sample failed to init!");
-    }
     if (sampleInfo->buffer == NULL) {
+      SDL_LogError(0, "sample failed to init!");
+      free(wavBuffer);
       return NULL;
     }
     for (size_t i = 0; i < bufferSize; ++i) {
@@ -70,12 +75,16 @@ LoadWAVSampleAsMono(Arena *arena, const std::string &samplePath) {
             float(wavLength / float(bytesPerSample * wavSpec.channels)) /
                 float(wavSpec.freq));
     bufferSize = wavLength / bytesPerSample;
+    if (!arena->canAllocArray<float>(bufferSize)) {
+      SDL_LogError(0, "sample arena is full!");
+      free(wavBuffer);
+      return NULL;
+    }
     sampleInfo = new (arena->push<SampleBuffer<float>>())
         SampleBuffer<float>(arena, wavSpec.freq, bufferSize, wavSpec.channels);
-    if (sampleInfo == NULL) {
-      SDL_LogError(0, "sample failed to init!");
-    }
     if (sampleInfo->buffer == NULL) {
+      SDL_LogError(0, "sample failed to init!");
+      free(wavBuffer);
       return NULL;
     }
     for (size_t i = 0; i < bufferSize; ++i) {
@@ -98,12 +107,16 @@ LoadWAVSampleAsMono(Arena *arena, const std::string &samplePath) {
             float(wavLength / float(bytesPerSample * wavSpec.channels)) /
                 float(wavSpec.freq));
     bufferSize = wavLength / bytesPerSample;
+    if (!arena->canAllocArray<float>(bufferSize)) {
+      SDL_LogError(0, "sample arena is full!");
+      free(wavBuffer);
+      return NULL;
+    }
     sampleInfo = new (arena->push<SampleBuffer<float>>())
         SampleBuffer<float>(arena, wavSpec.freq, bufferSize, wavSpec.channels);
-    if (sampleInfo == NULL) {
-      SDL_LogError(0, "sample failed to init!");
-    }
     if (sampleInfo->buffer == NULL) {
+      SDL_LogError(0, "sample failed to init!");
+      free(wavBuffer);
       return NULL;
     }
     for (size_t i = 0; i < bufferSize; ++i) {
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "SDL_log.h"
+#include "SDL_rwops.h"
+#include "sample_resample.h"
+#include "sample_stream.h"
+#include "sample_waveform.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A sample library decoded ahead of time: a header, an index with one entry
+// per sample, then the mono float frames of every sample followed by its
+// WaveformPyramid peaks, each starting on a cache line. Files are written in
+// native byte order for the machine that plays them, so the data can be used
+// straight out of a read-only mapping.
+struct SamplePackHeader {
+  static constexpr uint32_t MAGIC = 0x4b504446; // "FDPK"
+  // 2: waveform peaks stored with every entry
+  static constexpr uint32_t VERSION = 2;
+  uint32_t magic = MAGIC;
+  uint32_t version = VERSION;
+  uint32_t numEntries = 0;
+  uint32_t entrySize = 0;
+};
+
+struct SamplePackEntry {
+  static constexpr size_t MAX_NAME_LENGTH = 64;
+  // SamplerVoice plays a sample at its own pitch on note 36
+  static constexpr uint32_t DEFAULT_ROOT_NOTE = 36;
+  char name[MAX_NAME_LENGTH] = {};
+  uint32_t sampleRate = 0;
+  uint32_t rootNote = DEFAULT_ROOT_NOTE;
+  uint64_t numFrames = 0;
+  // from the start of the file
+  uint64_t dataOffset = 0;
+  // WaveformPyramid::countPeaks(numFrames) peaks, level after level
+  uint64_t waveformOffset = 0;
+  float peak = 0;
+  float rms = 0;
+};
+
+static constexpr size_t SAMPLE_PACK_ALIGNMENT = 64;
+
+static inline uint64_t AlignSamplePackOffset(const uint64_t offset) {
+  const uint64_t mask = SAMPLE_PACK_ALIGNMENT - 1;
+  return (offset + mask) & ~mask;
+}
+
+// Decodes every WAV file in wavPaths to mono float and writes them into one
+// pack, converted to sampleRate unless it is 0. Files that cannot be decoded
+// are skipped with a log message.
+static inline const bool
+WriteSamplePack(const std::string &packPath,
+                const std::vector<std::string> &wavPaths,
+                const uint32_t sampleRate = 0) {
+  std::vector<SamplePackEntry> entries;
+  std::vector<std::vector<float>> frames;
+  std::vector<std::vector<WaveformPyramid::Peak>> waveforms;
+  for (auto &wavPath : wavPaths) {
+    SDL_RWops *file = SDL_RWFromFile(wavPath.c_str(), "rb");
+    if (file == NULL) {
+      SDL_LogError(0, "sample pack: cannot open %s", wavPath.c_str());
+      continue;
+    }
+    WAVFormat format;
+    std::vector<uint8_t> bytes;
+    bool decoded = ReadWAVFormat(file, &format);
+    if (decoded) {
+      bytes.resize(format.numFrames * format.bytesPerFrame);
+      decoded =
+          SDL_RWseek(file, Sint64(format.dataOffset), RW_SEEK_SET) >= 0 &&
+          SDL_RWread(file, bytes.data(), format.bytesPerFrame,
+                     format.numFrames) == format.numFrames;
+    }
+    SDL_RWclose(file);
+    if (!decoded) {
+      SDL_LogError(0, "sample pack: cannot decode %s", wavPath.c_str());
+      continue;
+    }
+
+    frames.emplace_back(format.numFrames);
+    std::vector<float> &mono = frames.back();
+    DecodeWAVFrames<float>(format, bytes.data(), format.numFrames,
+                           mono.data());
+    if (sampleRate != 0 && format.sampleRate != sampleRate) {
+      PolyphaseResampler<float> resampler(format.sampleRate, sampleRate);
+      std::vector<float> converted(resampler.outputLength(mono.size()));
+      resampler.process(mono.data(), mono.size(), converted.data(),
+                        converted.size());
+      mono.swap(converted);
+      format.sampleRate = sampleRate;
+      format.numFrames = mono.size();
+    }
+    SamplePackEntry entry;
+    const size_t nameStart = wavPath.find_last_of("/\\");
+    const std::string name = nameStart == std::string::npos
+                                 ? wavPath
+                                 : wavPath.substr(nameStart + 1);
+    std::strncpy(entry.name, name.c_str(),
+                 SamplePackEntry::MAX_NAME_LENGTH - 1);
+    entry.sampleRate = format.sampleRate;
+    entry.numFrames = format.numFrames;
+    double sumOfSquares = 0;
+    for (const float frame : mono) {
+      const float magnitude = fabsf(frame);
+      entry.peak = magnitude > entry.peak ? magnitude : entry.peak;
+      sumOfSquares += double(frame) * double(frame);
+    }
+    entry.rms = mono.empty() ? 0 : float(sqrt(sumOfSquares / mono.size()));
+    entries.push_back(entry);
+
+    waveforms.emplace_back(WaveformPyramid::countPeaks(mono.size()));
+    WaveformPyramid waveform;
+    waveform.attach(waveforms.back().data(), mono.size());
+    waveform.add(mono.data(), mono.size());
+    waveform.finish();
+  }
+
+  SamplePackHeader header;
+  header.numEntries = uint32_t(entries.size());
+  header.entrySize = sizeof(SamplePackEntry);
+  uint64_t offset = sizeof(SamplePackHeader) +
+                    entries.size() * sizeof(SamplePackEntry);
+  for (auto &entry : entries) {
+    offset = AlignSamplePackOffset(offset);
+    entry.dataOffset = offset;
+    offset += entry.numFrames * sizeof(float);
+    offset = AlignSamplePackOffset(offset);
+    entry.waveformOffset = offset;
+    offset += WaveformPyramid::countPeaks(size_t(entry.numFrames)) *
+              sizeof(WaveformPyramid::Peak);
+  }
+
+  // A published kit may still map the old pack, and truncating a mapped file
+  // makes its next read fault with SIGBUS. The new pack is written next to it
+  // and renamed over it, so old mappings keep the old file.
+  const std::string temporaryPath = packPath + ".tmp";
+  SDL_RWops *pack = SDL_RWFromFile(temporaryPath.c_str(), "wb");
+  if (pack == NULL) {
+    SDL_LogError(0, "sample pack: cannot create %s", temporaryPath.c_str());
+    return false;
+  }
+  bool written = SDL_RWwrite(pack, &header, sizeof(header), 1) == 1;
+  if (!entries.empty()) {
+    written = written && SDL_RWwrite(pack, entries.data(),
+                                     sizeof(SamplePackEntry),
+                                     entries.size()) == entries.size();
+  }
+  const uint8_t padding[SAMPLE_PACK_ALIGNMENT] = {};
+  auto padTo = [pack, &padding](const uint64_t offset) {
+    const size_t padBytes = size_t(offset - uint64_t(SDL_RWtell(pack)));
+    return padBytes == 0 || SDL_RWwrite(pack, padding, padBytes, 1) == 1;
+  };
+  for (size_t i = 0; written && i < entries.size(); ++i) {
+    written = padTo(entries[i].dataOffset) &&
+              (frames[i].empty() ||
+               SDL_RWwrite(pack, frames[i].data(), sizeof(float),
+                           frames[i].size()) == frames[i].size()) &&
+              padTo(entries[i].waveformOffset) &&
+              SDL_RWwrite(pack, waveforms[i].data(),
+                          sizeof(WaveformPyramid::Peak),
+                          waveforms[i].size()) == waveforms[i].size();
+  }
+  written = SDL_RWclose(pack) == 0 && written;
+  if (!written) {
+    SDL_LogError(0, "sample pack: write to %s failed", temporaryPath.c_str());
+    remove(temporaryPath.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  // rename does not replace an existing file here
+  remove(packPath.c_str());
+#endif
+  if (rename(temporaryPath.c_str(), packPath.c_str()) != 0) {
+    SDL_LogError(0, "sample pack: cannot replace %s", packPath.c_str());
+    remove(temporaryPath.c_str());
+    return false;
+  }
+  SDL_Log("sample pack: wrote %d samples to %s", int(entries.size()),
+          packPath.c_str());
+  return true;
+}
+
+// Read-only view of a pack file. The sample data is never copied: the OS
+// pages it in on first touch and may drop it again under memory pressure, so
+// the first play of a sample can fault. Buffers handed out stay valid until
+// the pack is closed or destroyed.
+struct MappedSamplePack {
+  const uint8_t *data = NULL;
+  size_t size = 0;
+  const SamplePackHeader *header = NULL;
+  const SamplePackEntry *entries = NULL;
+
+  MappedSamplePack() = default;
+  MappedSamplePack(const MappedSamplePack &) = delete;
+  MappedSamplePack &operator=(const MappedSamplePack &) = delete;
+
+  inline bool isOpen() const { return data != NULL; }
+  inline size_t numEntries() const {
+    return header == NULL ? 0 : header->numEntries;
+  }
+  // true if every entry can be played without converting it
+  inline bool isAtRate(const uint32_t sampleRate) const {
+    for (size_t i = 0; i < numEntries(); ++i) {
+      if (entries[i].sampleRate != sampleRate) {
+        return false;
+      }
+    }
+    return true;
+  }
+  inline const float *frames(const size_t index) const {
+    return (const float *)(data + entries[index].dataOffset);
+  }
+  inline const WaveformPyramid::Peak *waveformPeaks(const size_t index) const {
+    return (const WaveformPyramid::Peak *)(data +
+                                           entries[index].waveformOffset);
+  }
+
+  bool open(const std::string &path) {
+    close();
+#ifdef _WIN32
+    return false;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 ||
+        size_t(status.st_size) < sizeof(SamplePackHeader)) {
+      ::close(fd);
+      return false;
+    }
+    void *mapping =
+        mmap(NULL, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+      SDL_LogError(0, "sample pack: cannot map %s", path.c_str());
+      return false;
+    }
+    data = (const uint8_t *)mapping;
+    size = size_t(status.st_size);
+    if (!validate()) {
+      SDL_LogError(0, "sample pack: %s is not a valid pack", path.c_str());
+      close();
+      return false;
+    }
+    return true;
+#endif
+  }
+
+  void close() {
+#ifndef _WIN32
+    if (data != NULL) {
+      munmap((void *)data, size);
+    }
+#endif
+    data = NULL;
+    size = 0;
+    header = NULL;
+    entries = NULL;
+  }
+
+  ~MappedSamplePack() { close(); }
+
+private:
+  // everything the index points at has to lie inside the file
+  bool validate() {
+    header = (const SamplePackHeader *)data;
+    if (header->magic != SamplePackHeader::MAGIC ||
+        header->version != SamplePackHeader::VERSION ||
+        header->entrySize != sizeof(SamplePackEntry)) {
+      return false;
+    }
+    const uint64_t indexEnd = sizeof(SamplePackHeader) +
+                              uint64_t(header->numEntries) *
+                                  sizeof(SamplePackEntry);
+    if (indexEnd > size) {
+      return false;
+    }
+    entries = (const SamplePackEntry *)(data + sizeof(SamplePackHeader));
+    for (size_t i = 0; i < header->numEntries; ++i) {
+      const SamplePackEntry &entry = entries[i];
+      if (entry.dataOffset < indexEnd ||
+          entry.dataOffset % SAMPLE_PACK_ALIGNMENT != 0 ||
+          entry.numFrames > (size - entry.dataOffset) / sizeof(float) ||
+          entry.sampleRate == 0) {
+        return false;
+      }
+      const uint64_t dataEnd =
+          entry.dataOffset + entry.numFrames * sizeof(float);
+      if (entry.waveformOffset < dataEnd || entry.waveformOffset > size ||
+          entry.waveformOffset % SAMPLE_PACK_ALIGNMENT != 0 ||
+          WaveformPyramid::countPeaks(size_t(entry.numFrames)) >
+              (size - entry.waveformOffset) / sizeof(WaveformPyramid::Peak)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Windowed-sinc sample rate converter for use at load time. The filter is
+// stored as NUM_PHASES + 1 polyphase rows over one input period, and each
+// output sample blends the two rows around its fractional position, so any
+// pair of rates works without finding a rational ratio. When downsampling,
+// the cutoff drops to the output Nyquist and the filter widens to match.
+// Long inputs can also be converted a piece at a time with seek() and push(),
+// which keep the input tail the next outputs still need between calls.
+// Not for the audio thread: building the table and converting both allocate.
+template <typename sample_t> struct PolyphaseResampler {
+  static constexpr size_t NUM_PHASES = 256;
+  // zero crossings on each side of the kernel at full bandwidth
+  static constexpr size_t ZERO_CROSSINGS = 16;
+  // passband edge as a fraction of the lower Nyquist, leaving room for the
+  // transition band below it
+  static constexpr double BANDWIDTH = 0.92;
+  static constexpr double KAISER_BETA = 9.0;
+
+  double step = 1;
+  size_t halfLength = ZERO_CROSSINGS;
+  // row p, tap k weights the input at floor(t) - halfLength + 1 + k for an
+  // output at fractional position p / NUM_PHASES past floor(t)
+  std::vector<double> rows;
+  // streaming state: history[0] is input frame historyStart, and nextOutput
+  // is the output frame the next push() starts at
+  std::vector<sample_t> history;
+  uint64_t historyStart = 0;
+  uint64_t nextOutput = 0;
+
+  PolyphaseResampler(const double inputRate, const double outputRate)
+      : step(inputRate / outputRate) {
+    const double cutoff = BANDWIDTH * (step > 1 ? 1 / step : 1);
+    halfLength = size_t(ceil(double(ZERO_CROSSINGS) / cutoff));
+    const size_t numTaps = 2 * halfLength;
+    rows.resize((NUM_PHASES + 1) * numTaps);
+    const double windowNorm = besselI0(KAISER_BETA);
+    for (size_t phase = 0; phase <= NUM_PHASES; ++phase) {
+      const double fraction = double(phase) / double(NUM_PHASES);
+      double *row = &rows[phase * numTaps];
+      double sum = 0;
+      for (size_t k = 0; k < numTaps; ++k) {
+        const double x = double(k) - double(halfLength - 1) - fraction;
+        const double r = x / double(halfLength);
+        const double window =
+            r * r < 1 ? besselI0(KAISER_BETA * sqrt(1 - r * r)) / windowNorm
+                      : 0;
+        const double arg = M_PI * cutoff * x;
+        const double sinc = fabs(arg) < 1e-12 ? 1 : sin(arg) / arg;
+        row[k] = cutoff * sinc * window;
+        sum += row[k];
+      }
+      // unity gain at DC for every phase, or the ripple shows up as noise
+      for (size_t k = 0; k < numTaps; ++k) {
+        row[k] /= sum;
+      }
+    }
+  }
+
+  static double besselI0(const double x) {
+    double sum = 1;
+    double term = 1;
+    const double quarterSquare = x * x / 4;
+    for (int n = 1; n < 64 && term > sum * 1e-17; ++n) {
+      term *= quarterSquare / double(n * n);
+      sum += term;
+    }
+    return sum;
+  }
+
+  inline size_t outputLength(const size_t inputLength) const {
+    return size_t(ceil(double(inputLength) / step));
+  }
+
+  // input outside [0, inputLength) counts as silence
+  void process(const sample_t *input, const size_t inputLength,
+               sample_t *output, const size_t outputLength) const {
+    for (size_t n = 0; n < outputLength; ++n) {
+      output[n] = sample_t(at(double(n) * step, input, 0, inputLength));
+    }
+  }
+
+  // Restarts streaming at output frame outputFrame.
+  void seek(const uint64_t outputFrame) {
+    nextOutput = outputFrame;
+    history.clear();
+    historyStart = firstInput(outputFrame);
+  }
+
+  // the input frame the next push() should start with
+  inline uint64_t nextInput() const { return historyStart + history.size(); }
+
+  // how many more input frames push() needs to write numOutputs frames
+  inline size_t inputWanted(const size_t numOutputs) const {
+    if (numOutputs == 0) {
+      return 0;
+    }
+    const uint64_t last = nextOutput + numOutputs - 1;
+    const uint64_t end = uint64_t(double(last) * step) + halfLength + 1;
+    return end > nextInput() ? size_t(end - nextInput()) : 0;
+  }
+
+  // Appends the next inputLength input frames and writes the outputs they
+  // complete, at most maxOutputs. With endOfInput set, input past the end
+  // counts as silence. Returns how many outputs were written.
+  size_t push(const sample_t *input, const size_t inputLength,
+              sample_t *output, const size_t maxOutputs,
+              const bool endOfInput) {
+    history.insert(history.end(), input, input + inputLength);
+    const uint64_t end = nextInput();
+    const uint64_t numOutputs =
+        endOfInput ? uint64_t(ceil(double(end) / step)) : 0;
+    size_t written = 0;
+    while (written < maxOutputs) {
+      const double t = double(nextOutput) * step;
+      if (endOfInput ? nextOutput >= numOutputs
+                     : uint64_t(t) + halfLength + 1 > end) {
+        break;
+      }
+      output[written++] = sample_t(at(t, history.data(), long(historyStart),
+                                      history.size()));
+      ++nextOutput;
+    }
+    const uint64_t keepFrom = firstInput(nextOutput);
+    if (keepFrom > historyStart) {
+      const size_t drop = keepFrom - historyStart < history.size()
+                              ? size_t(keepFrom - historyStart)
+                              : history.size();
+      history.erase(history.begin(), history.begin() + long(drop));
+      historyStart += drop;
+    }
+    return written;
+  }
+
+private:
+  // the first input frame output frame n reads
+  inline uint64_t firstInput(const uint64_t n) const {
+    const uint64_t index = uint64_t(double(n) * step);
+    return index + 1 > halfLength ? index + 1 - halfLength : 0;
+  }
+
+  // the output at input position t, where input[0] is input frame
+  // inputStart and frames outside the input count as silence
+  inline double at(const double t, const sample_t *input,
+                   const long inputStart, const size_t inputLength) const {
+    const size_t numTaps = 2 * halfLength;
+    const size_t index = size_t(t);
+    const double phasePosition = (t - double(index)) * double(NUM_PHASES);
+    const size_t phase = size_t(phasePosition);
+    const double phaseMix = phasePosition - double(phase);
+    const double *lower = &rows[phase * numTaps];
+    const double *upper = lower + numTaps;
+    const long first = long(index) - long(halfLength) + 1 - inputStart;
+    // only the taps that land inside the input
+    const size_t begin = first < 0 ? size_t(-first) : 0;
+    const long available = long(inputLength) - first;
+    const size_t end =
+        available < long(numTaps) ? (available < 0 ? 0 : size_t(available))
+                                  : numTaps;
+    double sum = 0;
+    for (size_t k = begin; k < end; ++k) {
+      const double weight = lower[k] + phaseMix * (upper[k] - lower[k]);
+      sum += weight * double(input[first + long(k)]);
+    }
+    return sum;
+  }
+};
@@ -0,0 +1,475 @@
+#pragma once
+
+#include "SDL_log.h"
+#include "SDL_rwops.h"
+#include "arena.h"
+#include "sample_buffer.h"
+#include "sample_resample.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where the PCM data of a WAV file lives and how to decode it, read from the
+// RIFF header without touching the data itself.
+struct WAVFormat {
+  enum Encoding { PCM_16, PCM_32, FLOAT_32 } encoding = PCM_16;
+  uint32_t sampleRate = 0;
+  uint16_t numChannels = 0;
+  uint16_t bytesPerFrame = 0;
+  uint64_t dataOffset = 0;
+  uint64_t numFrames = 0;
+};
+
+static inline const bool ReadWAVFormat(SDL_RWops *file, WAVFormat *format) {
+  if (SDL_RWseek(file, 0, RW_SEEK_SET) < 0) {
+    return false;
+  }
+  const uint32_t RIFF = 0x46464952, WAVE = 0x45564157;
+  const uint32_t FMT = 0x20746d66, DATA = 0x61746164;
+  if (SDL_ReadLE32(file) != RIFF) {
+    return false;
+  }
+  SDL_ReadLE32(file);
+  if (SDL_ReadLE32(file) != WAVE) {
+    return false;
+  }
+  bool hasFormat = false;
+  uint16_t formatTag = 0;
+  uint16_t bitsPerSample = 0;
+  while (true) {
+    const uint32_t chunkId = SDL_ReadLE32(file);
+    const uint32_t chunkSize = SDL_ReadLE32(file);
+    const Sint64 chunkStart = SDL_RWseek(file, 0, RW_SEEK_CUR);
+    if (chunkId == 0 || chunkStart < 0) {
+      return false;
+    }
+    if (chunkId == FMT) {
+      formatTag = SDL_ReadLE16(file);
+      format->numChannels = SDL_ReadLE16(file);
+      format->sampleRate = SDL_ReadLE32(file);
+      SDL_ReadLE32(file);
+      format->bytesPerFrame = SDL_ReadLE16(file);
+      bitsPerSample = SDL_ReadLE16(file);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of its
+      // sub-format GUID
+      if (formatTag == 0xFFFE && chunkSize >= 26) {
+        SDL_ReadLE16(file);
+        SDL_ReadLE16(file);
+        SDL_ReadLE32(file);
+        formatTag = SDL_ReadLE16(file);
+      }
+      hasFormat = true;
+    } else if (chunkId == DATA) {
+      if (!hasFormat || format->numChannels == 0 ||
+          format->bytesPerFrame == 0) {
+        return false;
+      }
+      format->dataOffset = uint64_t(chunkStart);
+      format->numFrames = chunkSize / format->bytesPerFrame;
+      break;
+    }
+    // chunks are padded to an even size
+    if (SDL_RWseek(file, chunkStart + chunkSize + (chunkSize & 1),
+                   RW_SEEK_SET) < 0) {
+      return false;
+    }
+  }
+  if (formatTag == 1 && bitsPerSample == 16) {
+    format->encoding = WAVFormat::PCM_16;
+    return true;
+  }
+  if (formatTag == 1 && bitsPerSample == 32) {
+    format->encoding = WAVFormat::PCM_32;
+    return true;
+  }
+  if (formatTag == 3 && bitsPerSample == 32) {
+    format->encoding = WAVFormat::FLOAT_32;
+    return true;
+  }
+  return false;
+}
+
+// interleaved frames to mono, channels summed like LoadWAVSampleAsMono
+template <typename sample_t>
+static inline void DecodeWAVFrames(const WAVFormat &format,
+                                   const uint8_t *bytes,
+                                   const size_t numFrames, sample_t *output) {
+  const size_t numSamples = numFrames * format.numChannels;
+  for (size_t i = 0; i < numFrames; ++i) {
+    output[i] = 0;
+  }
+  for (size_t i = 0; i < numSamples; ++i) {
+    sample_t value = 0;
+    switch (format.encoding) {
+    case WAVFormat::PCM_16: {
+      int16_t pcm;
+      std::memcpy(&pcm, bytes + i * sizeof(pcm), sizeof(pcm));
+      value = sample_t(pcm) / sample_t(std::numeric_limits<int16_t>::max());
+      break;
+    }
+    case WAVFormat::PCM_32: {
+      int32_t pcm;
+      std::memcpy(&pcm, bytes + i * sizeof(pcm), sizeof(pcm));
+      value = sample_t(pcm) / sample_t(std::numeric_limits<int32_t>::max());
+      break;
+    }
+    case WAVFormat::FLOAT_32: {
+      float pcm;
+      std::memcpy(&pcm, bytes + i * sizeof(pcm), sizeof(pcm));
+      value = sample_t(pcm);
+      break;
+    }
+    }
+    output[i / format.numChannels] += value;
+  }
+}
+
+// A sample too long to keep in memory. The bank holds a resident SampleBuffer
+// with its first HEAD_SECONDS; everything after that is read from disk while
+// it plays. format describes the file; frames are played, and counted, at
+// sampleRate, and a file at another rate is resampled as it is read.
+template <typename sample_t> struct StreamedSample {
+  static constexpr size_t MAX_PATH_LENGTH = 512;
+  char path[MAX_PATH_LENGTH] = {};
+  WAVFormat format;
+  uint32_t sampleRate = 0;
+  uint64_t numFrames = 0;
+  size_t headFrames = 0;
+
+  inline const bool needsResampling() const {
+    return format.sampleRate != sampleRate;
+  }
+};
+
+// Reads numFrames frames of streamedSample from frame on into output. With a
+// resampler the file is read from where the resampler left off, so it must
+// have been seeked to frame. Returns the number of frames written, which is
+// only short at the end of the sample or on a read error.
+template <typename sample_t>
+static inline const size_t
+ReadStreamedFrames(SDL_RWops *file,
+                   const StreamedSample<sample_t> &streamedSample,
+                   PolyphaseResampler<sample_t> *resampler,
+                   const uint64_t frame, size_t numFrames,
+                   std::vector<uint8_t> &bytes,
+                   std::vector<sample_t> &decoded, sample_t *output) {
+  const WAVFormat &format = streamedSample.format;
+  if (frame + numFrames > streamedSample.numFrames) {
+    numFrames = size_t(streamedSample.numFrames - frame);
+  }
+  const uint64_t inputFrame =
+      resampler != NULL ? resampler->nextInput() : frame;
+  size_t inputCount =
+      resampler != NULL ? resampler->inputWanted(numFrames) : numFrames;
+  if (inputFrame + inputCount > format.numFrames) {
+    inputCount = inputFrame < format.numFrames
+                     ? size_t(format.numFrames - inputFrame)
+                     : 0;
+  }
+  bytes.resize(inputCount * format.bytesPerFrame);
+  decoded.resize(inputCount);
+  const uint64_t offset = format.dataOffset + inputFrame * format.bytesPerFrame;
+  if (inputCount > 0 &&
+      (SDL_RWseek(file, Sint64(offset), RW_SEEK_SET) < 0 ||
+       SDL_RWread(file, bytes.data(), format.bytesPerFrame, inputCount) !=
+           inputCount)) {
+    return 0;
+  }
+  if (resampler == NULL) {
+    DecodeWAVFrames<sample_t>(format, bytes.data(), inputCount, output);
+    return inputCount;
+  }
+  DecodeWAVFrames<sample_t>(format, bytes.data(), inputCount,
+                            decoded.data());
+  return resampler->push(decoded.data(), inputCount, output, numFrames,
+                         inputFrame + inputCount >= format.numFrames);
+}
+
+// One voice layer's window onto a streamed sample. The audio thread asks for
+// playback from a frame with start(); the reader thread refills the ring
+// ahead of readFrom and publishes how far it got in writtenUntil. Frames are
+// counted from the start of the file, so a ring slot is frame % RING_FRAMES.
+template <typename sample_t> struct SampleStream {
+  static constexpr size_t RING_FRAMES = 32768;
+  static constexpr size_t CHUNK_FRAMES = 4096;
+
+  sample_t ring[RING_FRAMES];
+  std::atomic<const void *> owner = NULL;
+  // audio thread -> reader
+  std::atomic<const StreamedSample<sample_t> *> sample = NULL;
+  std::atomic<uint64_t> startFrame = 0;
+  std::atomic<uint64_t> readFrom = 0;
+  std::atomic<uint32_t> requestedGeneration = 0;
+  // reader -> audio thread
+  std::atomic<uint32_t> filledGeneration = 0;
+  std::atomic<uint64_t> writtenUntil = 0;
+  std::atomic<uint32_t> underruns = 0;
+
+  // audio thread; returns the generation to pass to read()
+  inline const uint32_t start(const StreamedSample<sample_t> *streamedSample,
+                              const uint64_t frame) {
+    sample.store(streamedSample, std::memory_order_relaxed);
+    startFrame.store(frame, std::memory_order_relaxed);
+    readFrom.store(frame, std::memory_order_relaxed);
+    return requestedGeneration.fetch_add(1, std::memory_order_release) + 1;
+  }
+
+  // audio thread; lets the reader reuse the ring behind position
+  inline void advance(const uint64_t frame) {
+    readFrom.store(frame, std::memory_order_release);
+  }
+
+  // audio thread; interpolated read at a position the reader has already
+  // delivered, silence (and an underrun) otherwise
+  inline const sample_t read(const uint32_t generation,
+                             const sample_t position,
+                             const uint64_t lastFrame) {
+    const uint64_t index = uint64_t(position);
+    const uint64_t nextIndex = index < lastFrame ? index + 1 : lastFrame;
+    if (filledGeneration.load(std::memory_order_acquire) != generation ||
+        nextIndex >= writtenUntil.load(std::memory_order_acquire) ||
+        index < startFrame.load(std::memory_order_relaxed)) {
+      underruns.fetch_add(1, std::memory_order_relaxed);
+      return 0;
+    }
+    const sample_t a = ring[index & (RING_FRAMES - 1)];
+    const sample_t b = ring[nextIndex & (RING_FRAMES - 1)];
+    return a + (position - sample_t(index)) * (b - a);
+  }
+};
+
+// Owns the streams and the thread that feeds them. Streams are claimed by an
+// owner address (a voice layer) so a voice finds the same stream again after
+// its engine is rebuilt in place; claiming is a compare-and-swap and safe on
+// the audio thread.
+template <typename sample_t> struct SampleStreamer {
+  static constexpr size_t NUM_STREAMS = 16;
+  static constexpr int IDLE_SLEEP_MILLIS = 2;
+
+  SampleStream<sample_t> streams[NUM_STREAMS];
+  std::atomic<size_t> nextSteal = 0;
+  std::atomic<bool> running = false;
+  std::thread reader;
+  // held by the reader while it services a stream and by forget(); never
+  // taken on the audio thread
+  std::mutex serviceMutex;
+
+  // reader thread state
+  SDL_RWops *files[NUM_STREAMS] = {};
+  const StreamedSample<sample_t> *openSamples[NUM_STREAMS] = {};
+  uint32_t handledGenerations[NUM_STREAMS] = {};
+  // one per stream playing a file that is not at the bank rate
+  std::unique_ptr<PolyphaseResampler<sample_t>> resamplers[NUM_STREAMS];
+  std::vector<uint8_t> chunkBytes;
+  std::vector<sample_t> chunkInput;
+  std::vector<sample_t> chunkFrames;
+
+  ~SampleStreamer() { stop(); }
+
+  inline void start() {
+    if (running.exchange(true)) {
+      return;
+    }
+    reader = std::thread([this]() { readLoop(); });
+  }
+
+  inline void stop() {
+    if (!running.exchange(false)) {
+      return;
+    }
+    reader.join();
+    for (size_t i = 0; i < NUM_STREAMS; ++i) {
+      if (files[i] != NULL) {
+        SDL_RWclose(files[i]);
+        files[i] = NULL;
+      }
+      openSamples[i] = NULL;
+      resamplers[i].reset();
+    }
+  }
+
+  inline SampleStream<sample_t> *acquire(const void *owner) {
+    for (auto &stream : streams) {
+      if (stream.owner.load(std::memory_order_relaxed) == owner) {
+        return &stream;
+      }
+    }
+    for (auto &stream : streams) {
+      const void *expected = NULL;
+      if (stream.owner.compare_exchange_strong(expected, owner)) {
+        return &stream;
+      }
+    }
+    // more owners than streams, e.g. several synthesizers sharing a bank
+    SampleStream<sample_t> &stolen =
+        streams[nextSteal.fetch_add(1) % NUM_STREAMS];
+    stolen.owner.store(owner);
+    return &stolen;
+  }
+
+  // Non-realtime. Once this returns the reader holds no reference to
+  // streamedSample, so it can be freed; the audio thread must already be
+  // unable to start it again.
+  inline void forget(const StreamedSample<sample_t> *streamedSample) {
+    std::lock_guard<std::mutex> lock(serviceMutex);
+    for (size_t i = 0; i < NUM_STREAMS; ++i) {
+      const StreamedSample<sample_t> *expected = streamedSample;
+      streams[i].sample.compare_exchange_strong(expected, NULL);
+      if (openSamples[i] == streamedSample) {
+        if (files[i] != NULL) {
+          SDL_RWclose(files[i]);
+          files[i] = NULL;
+        }
+        openSamples[i] = NULL;
+        resamplers[i].reset();
+      }
+    }
+  }
+
+  inline void readLoop() {
+    while (running.load(std::memory_order_relaxed)) {
+      bool didWork = false;
+      for (size_t i = 0; i < NUM_STREAMS; ++i) {
+        std::lock_guard<std::mutex> lock(serviceMutex);
+        didWork |= service(i);
+      }
+      if (!didWork) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(IDLE_SLEEP_MILLIS));
+      }
+    }
+  }
+
+  // reader thread; restarts the stream on a new request and tops up its ring
+  // by one chunk. Returns whether anything was read
+  inline const bool service(const size_t streamIndex) {
+    SampleStream<sample_t> &stream = streams[streamIndex];
+    const uint32_t generation =
+        stream.requestedGeneration.load(std::memory_order_acquire);
+    const StreamedSample<sample_t> *streamedSample =
+        stream.sample.load(std::memory_order_relaxed);
+    if (streamedSample == NULL) {
+      return false;
+    }
+    if (generation != handledGenerations[streamIndex]) {
+      handledGenerations[streamIndex] = generation;
+      if (openSamples[streamIndex] != streamedSample) {
+        if (files[streamIndex] != NULL) {
+          SDL_RWclose(files[streamIndex]);
+        }
+        files[streamIndex] = SDL_RWFromFile(streamedSample->path, "rb");
+        openSamples[streamIndex] = streamedSample;
+        resamplers[streamIndex].reset(
+            streamedSample->needsResampling()
+                ? new PolyphaseResampler<sample_t>(
+                      double(streamedSample->format.sampleRate),
+                      double(streamedSample->sampleRate))
+                : NULL);
+        if (files[streamIndex] == NULL) {
+          SDL_LogError(0, "could not open %s for streaming",
+                       streamedSample->path);
+        }
+      }
+      const uint64_t startFrame =
+          stream.startFrame.load(std::memory_order_relaxed);
+      if (resamplers[streamIndex] != NULL) {
+        resamplers[streamIndex]->seek(startFrame);
+      }
+      stream.writtenUntil.store(startFrame, std::memory_order_relaxed);
+      stream.filledGeneration.store(generation, std::memory_order_release);
+    }
+    SDL_RWops *file = files[streamIndex];
+    const uint64_t written =
+        stream.writtenUntil.load(std::memory_order_relaxed);
+    const uint64_t readFrom = stream.readFrom.load(std::memory_order_acquire);
+    const uint64_t limit = readFrom + SampleStream<sample_t>::RING_FRAMES;
+    if (file == NULL || written >= streamedSample->numFrames ||
+        written + SampleStream<sample_t>::CHUNK_FRAMES > limit) {
+      return false;
+    }
+
+    chunkFrames.resize(SampleStream<sample_t>::CHUNK_FRAMES);
+    const size_t numFrames = ReadStreamedFrames<sample_t>(
+        file, *streamedSample, resamplers[streamIndex].get(), written,
+        SampleStream<sample_t>::CHUNK_FRAMES, chunkBytes, chunkInput,
+        chunkFrames.data());
+    if (numFrames == 0) {
+      SDL_LogError(0, "short read while streaming %s", streamedSample->path);
+      return false;
+    }
+    // a newer request makes this chunk stale
+    if (stream.requestedGeneration.load(std::memory_order_acquire) !=
+        generation) {
+      return true;
+    }
+    for (size_t i = 0; i < numFrames; ++i) {
+      stream.ring[(written + i) & (SampleStream<sample_t>::RING_FRAMES - 1)] =
+          chunkFrames[i];
+    }
+    stream.writtenUntil.store(written + numFrames, std::memory_order_release);
+    return true;
+  }
+};
+
+// Binds one voice layer to a bank entry. Resident entries are read straight
+// from their buffer; streamed ones read the resident head first and then the
+// stream, which was started at the end of the head so it has the head's
+// length to fill up before it is needed.
+template <typename sample_t> struct StreamedLayerReader {
+  SampleStream<sample_t> *stream = NULL;
+  const StreamedSample<sample_t> *boundSample = NULL;
+  uint32_t generation = 0;
+
+  inline void bind(SampleStreamer<sample_t> *streamer,
+                   const StreamedSample<sample_t> *streamedSample,
+                   const sample_t position) {
+    if (streamedSample == boundSample || streamer == NULL) {
+      return;
+    }
+    boundSample = streamedSample;
+    if (streamedSample == NULL) {
+      return;
+    }
+    if (stream == NULL) {
+      stream = streamer->acquire(this);
+    }
+    const uint64_t headLastFrame = streamedSample->headFrames - 1;
+    const uint64_t frame = uint64_t(position);
+    generation =
+        stream->start(streamedSample, frame > headLastFrame ? frame
+                                                            : headLastFrame);
+  }
+
+  // forces the next bind to restart the stream, e.g. on a new note
+  inline void unbind() { boundSample = NULL; }
+
+  inline const sample_t read(const SampleBuffer<sample_t> *head,
+                             const sample_t position) {
+    const sample_t headLastFrame = sample_t(head->bufferSize - 1);
+    if (boundSample == NULL || position < headLastFrame) {
+      const sample_t clamped =
+          position < headLastFrame ? position : headLastFrame;
+      const size_t index = size_t(clamped);
+      const size_t nextIndex =
+          index + 1 < head->bufferSize ? index + 1 : index;
+      const sample_t current = head->frame(index);
+      return current +
+             (clamped - sample_t(index)) * (head->frame(nextIndex) - current);
+    }
+    return stream->read(generation, position, boundSample->numFrames - 1);
+  }
+
+  inline void advance(const sample_t position) {
+    if (boundSample != NULL && position >= sample_t(boundSample->headFrames)) {
+      stream->advance(uint64_t(position));
+    }
+  }
+};
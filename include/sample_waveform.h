@@ -0,0 +1,153 @@
+#pragma once
+
+#include "arena.h"
+#include <cstddef>
+
+// Min/max envelope of a sample at every power-of-two zoom, for drawing
+// thumbnails without touching the audio data. Level 0 has one peak per
+// BASE_FRAMES frames and every level above halves the one below, so any view
+// can be drawn from the level whose buckets are just narrower than a pixel,
+// reading at most a few buckets per pixel. Built on the loader thread and
+// read-only afterwards.
+struct WaveformPyramid {
+  static constexpr size_t BASE_FRAMES = 256;
+  static constexpr size_t MAX_LEVELS = 32;
+
+  struct Peak {
+    float min;
+    float max;
+  };
+
+  size_t numFrames = 0;
+  size_t numLevels = 0;
+  Peak *levels[MAX_LEVELS] = {};
+  size_t levelSizes[MAX_LEVELS] = {};
+  size_t framesAdded = 0;
+
+  // sets numFrames, numLevels and levelSizes; returns the number of peaks in
+  // all levels together
+  size_t layout(const size_t _numFrames) {
+    numFrames = _numFrames;
+    size_t size = (numFrames + BASE_FRAMES - 1) / BASE_FRAMES;
+    size = size < 1 ? 1 : size;
+    size_t totalSize = 0;
+    numLevels = 0;
+    while (numLevels < MAX_LEVELS) {
+      levelSizes[numLevels++] = size;
+      totalSize += size;
+      if (size == 1) {
+        break;
+      }
+      size = (size + 1) / 2;
+    }
+    return totalSize;
+  }
+
+  static size_t countPeaks(const size_t numFrames) {
+    WaveformPyramid waveform;
+    return waveform.layout(numFrames);
+  }
+
+  // false if the arena cannot hold every level
+  bool allocate(Arena *arena, const size_t _numFrames) {
+    const size_t totalSize = layout(_numFrames);
+    const size_t padding = numLevels * Arena::CACHE_LINE;
+    if (!arena->canAllocArray<Peak>(totalSize + padding)) {
+      return false;
+    }
+    for (size_t level = 0; level < numLevels; ++level) {
+      levels[level] = arena->pushArray<Peak>(levelSizes[level]);
+    }
+    for (size_t i = 0; i < levelSizes[0]; ++i) {
+      levels[0][i] = {0, 0};
+    }
+    return true;
+  }
+
+  // Uses countPeaks(numFrames) peaks stored level after level, as a sample
+  // pack holds them. Empty storage is filled by add and finish as usual;
+  // peaks already built, e.g. in a read-only pack mapping, are only queried.
+  void attach(Peak *storage, const size_t _numFrames) {
+    layout(_numFrames);
+    for (size_t level = 0; level < numLevels; ++level) {
+      levels[level] = storage;
+      storage += levelSizes[level];
+    }
+    framesAdded = 0;
+  }
+
+  // frames arrive in order, in runs of any length
+  template <typename sample_t>
+  inline void add(const sample_t *frames, const size_t count) {
+    for (size_t i = 0; i < count && framesAdded < numFrames; ++i) {
+      Peak &peak = levels[0][framesAdded / BASE_FRAMES];
+      const float value = float(frames[i]);
+      if (framesAdded % BASE_FRAMES == 0) {
+        peak = {value, value};
+      } else {
+        peak.min = value < peak.min ? value : peak.min;
+        peak.max = value > peak.max ? value : peak.max;
+      }
+      ++framesAdded;
+    }
+  }
+
+  // builds the upper levels once every frame has been added
+  void finish() {
+    for (size_t level = 1; level < numLevels; ++level) {
+      const Peak *below = levels[level - 1];
+      const size_t belowSize = levelSizes[level - 1];
+      for (size_t i = 0; i < levelSizes[level]; ++i) {
+        Peak peak = below[2 * i];
+        if (2 * i + 1 < belowSize) {
+          const Peak &next = below[2 * i + 1];
+          peak.min = next.min < peak.min ? next.min : peak.min;
+          peak.max = next.max > peak.max ? next.max : peak.max;
+        }
+        levels[level][i] = peak;
+      }
+    }
+  }
+
+  // One min/max pair per pixel for the frames [startFrame, endFrame). When a
+  // pixel is narrower than BASE_FRAMES the level 0 peaks are repeated.
+  void query(const double startFrame, const double endFrame,
+             const size_t numPixels, Peak *output) const {
+    if (numLevels == 0 || numPixels == 0 || endFrame <= startFrame) {
+      for (size_t pixel = 0; pixel < numPixels; ++pixel) {
+        output[pixel] = {0, 0};
+      }
+      return;
+    }
+    const double framesPerPixel = (endFrame - startFrame) / double(numPixels);
+    size_t level = 0;
+    while (level + 1 < numLevels &&
+           double(BASE_FRAMES << (level + 1)) <= framesPerPixel) {
+      ++level;
+    }
+    const double bucketFrames = double(BASE_FRAMES << level);
+    const Peak *peaks = levels[level];
+    const size_t lastBucket = levelSizes[level] - 1;
+    for (size_t pixel = 0; pixel < numPixels; ++pixel) {
+      const double from = startFrame + double(pixel) * framesPerPixel;
+      const double to = from + framesPerPixel;
+      if (from >= double(numFrames) || to <= 0) {
+        output[pixel] = {0, 0};
+        continue;
+      }
+      // a pixel ending on a bucket boundary does not reach into the next one
+      size_t first = from > 0 ? size_t(from / bucketFrames) : 0;
+      size_t last = to > 1 ? size_t((to - 1) / bucketFrames) : 0;
+      first = first < lastBucket ? first : lastBucket;
+      last = last < lastBucket ? last : lastBucket;
+      last = last > first ? last : first;
+      Peak peak = peaks[first];
+      for (size_t bucket = first + 1; bucket <= last; ++bucket) {
+        const Peak &next = peaks[bucket];
+        peak.min = next.min < peak.min ? next.min : peak.min;
+        peak.max = next.max > peak.max ? next.max : peak.max;
+      }
+      output[pixel] = peak;
+    }
+  }
+};
@@ -76,6 +76,9 @@ private:
 
 public:
   InputMapping<float> sensorMapping;
+  // draws the dsp load and xrun count over the UI; off until switched on in
+  // the settings, and not saved with the game
+  bool showAudioLoad = false;
 
   inline InstrumentMetaphorType getInstrumentMetaphorType() const {
     return instrumentMetaphor;
@@ -18,6 +18,7 @@ public:
   constexpr static const float minBPM = 1;
   constexpr static const float maxBPM = 300;
   Synthesizer<float> *synth = NULL;
+  Synthesizer<float>::EventLane *eventLane = NULL;
   SaveState *saveState = NULL;
   SDL_Thread *sequencerThread = NULL;
   static const size_t MAX_STEPS = 16;
@@ -26,18 +27,21 @@ public:
 
   float timeSinceLastStep = 0;
   int currentStep = 0;
+  int gatedStep = 0;
   bool hadNoteOn = false;
 
   Sequencer(Synthesizer<float> *_synthesizer, SaveState *_saveState)
       : synth(_synthesizer), saveState(_saveState) {
+    eventLane = synth->registerEventProducer("sequencer");
     setTempo(tempoBPM);
   }
 
   void start() { running = true; }
 
   void stop() {
-    saveState->sensorMapping.emitEvent(
-        synth, SEQUENCER, MomentaryInputType::SEQUENCER_GATE, false);
+    saveState->sensorMapping.emitEvent(synth, SEQUENCER,
+                                       MomentaryInputType::SEQUENCER_GATE,
+                                       false, ALL_VOICE_KEYS, eventLane);
     running = false;
   }
 
@@ -86,7 +90,9 @@ public:
               synth, SEQUENCER, ContinuousInputType::SEQUENCER_STEP_LEVEL,
               stepValues[currentStep]);
           saveState->sensorMapping.emitEvent(
-              synth, SEQUENCER, MomentaryInputType::SEQUENCER_GATE, true);
+              synth, SEQUENCER, MomentaryInputType::SEQUENCER_GATE, true,
+              currentStep, eventLane);
+          gatedStep = currentStep;
         }
         currentStep = (currentStep + 1) % length;
         timeSinceLastStep = 0;
@@ -94,7 +100,8 @@ public:
       } else if (hadNoteOn &&
                  (timeSinceLastStep >= (stepIntervalSeconds / 2))) {
         saveState->sensorMapping.emitEvent(
-            synth, SEQUENCER, MomentaryInputType::SEQUENCER_GATE, false);
+            synth, SEQUENCER, MomentaryInputType::SEQUENCER_GATE, false,
+            gatedStep, eventLane);
       }
     }
   }
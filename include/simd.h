@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Thin wrapper over the vector units we ship on: AVX2 (8 lanes) or SSE2 (4
+// lanes) on desktop, NEON (4 lanes) on arm64 phones, and a plain 4-lane
+// struct everywhere else. DSP kernels are written once against these
+// overloads and also instantiate with float/uint32_t/bool for the scalar
+// path, so both paths run the same arithmetic. The one exception is division
+// on armv7 NEON, which is a refined reciprocal estimate rather than IEEE.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#endif
+
+namespace simd {
+
+#if defined(SIMD_AVX2)
+static constexpr size_t LANES = 8;
+static constexpr size_t ALIGNMENT = 32;
+struct vfloat {
+  __m256 v;
+};
+struct vuint {
+  __m256i v;
+};
+struct vmask {
+  __m256 v;
+};
+inline vfloat load(const float *p) { return {_mm256_load_ps(p)}; }
+inline void store(float *p, vfloat a) { _mm256_store_ps(p, a.v); }
+inline vuint load(const uint32_t *p) {
+  return {_mm256_load_si256((const __m256i *)p)};
+}
+inline void store(uint32_t *p, vuint a) {
+  _mm256_store_si256((__m256i *)p, a.v);
+}
+inline vfloat broadcast(float x) { return {_mm256_set1_ps(x)}; }
+inline vfloat operator+(vfloat a, vfloat b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline vfloat operator-(vfloat a, vfloat b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline vfloat operator*(vfloat a, vfloat b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline vfloat operator/(vfloat a, vfloat b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline vfloat min(vfloat a, vfloat b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline vfloat max(vfloat a, vfloat b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline vmask lessThan(vfloat a, vfloat b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)};
+}
+inline vmask greaterThan(vfloat a, vfloat b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)};
+}
+inline vmask greaterEqual(vfloat a, vfloat b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)};
+}
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+  return {_mm256_blendv_ps(b.v, a.v, m.v)};
+}
+inline vuint operator^(vuint a, vuint b) {
+  return {_mm256_xor_si256(a.v, b.v)};
+}
+inline vuint shiftLeft(vuint a, int n) { return {_mm256_slli_epi32(a.v, n)}; }
+inline vuint shiftRight(vuint a, int n) {
+  return {_mm256_srli_epi32(a.v, n)};
+}
+inline vfloat toSignedFloat(vuint a) { return {_mm256_cvtepi32_ps(a.v)}; }
+// LANES int16 values from any address, widened to float
+inline vfloat loadInt16(const int16_t *p) {
+  const __m128i pcm = _mm_loadu_si128((const __m128i *)p);
+  return {_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(pcm))};
+}
+
+#elif defined(SIMD_SSE2)
+static constexpr size_t LANES = 4;
+static constexpr size_t ALIGNMENT = 16;
+struct vfloat {
+  __m128 v;
+};
+struct vuint {
+  __m128i v;
+};
+struct vmask {
+  __m128 v;
+};
+inline vfloat load(const float *p) { return {_mm_load_ps(p)}; }
+inline void store(float *p, vfloat a) { _mm_store_ps(p, a.v); }
+inline vuint load(const uint32_t *p) {
+  return {_mm_load_si128((const __m128i *)p)};
+}
+inline void store(uint32_t *p, vuint a) { _mm_store_si128((__m128i *)p, a.v); }
+inline vfloat broadcast(float x) { return {_mm_set1_ps(x)}; }
+inline vfloat operator+(vfloat a, vfloat b) { return {_mm_add_ps(a.v, b.v)}; }
+inline vfloat operator-(vfloat a, vfloat b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline vfloat operator*(vfloat a, vfloat b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline vfloat operator/(vfloat a, vfloat b) { return {_mm_div_ps(a.v, b.v)}; }
+inline vfloat min(vfloat a, vfloat b) { return {_mm_min_ps(a.v, b.v)}; }
+inline vfloat max(vfloat a, vfloat b) { return {_mm_max_ps(a.v, b.v)}; }
+inline vmask lessThan(vfloat a, vfloat b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline vmask greaterThan(vfloat a, vfloat b) {
+  return {_mm_cmpgt_ps(a.v, b.v)};
+}
+inline vmask greaterEqual(vfloat a, vfloat b) {
+  return {_mm_cmpge_ps(a.v, b.v)};
+}
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+  return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+}
+inline vuint operator^(vuint a, vuint b) { return {_mm_xor_si128(a.v, b.v)}; }
+inline vuint shiftLeft(vuint a, int n) { return {_mm_slli_epi32(a.v, n)}; }
+inline vuint shiftRight(vuint a, int n) { return {_mm_srli_epi32(a.v, n)}; }
+inline vfloat toSignedFloat(vuint a) { return {_mm_cvtepi32_ps(a.v)}; }
+inline vfloat loadInt16(const int16_t *p) {
+  const __m128i pcm = _mm_loadl_epi64((const __m128i *)p);
+  // SSE2 has no sign extension: put each value in the top half of a lane and
+  // shift it back down arithmetically
+  return {_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16))};
+}
+
+#elif defined(SIMD_NEON)
+static constexpr size_t LANES = 4;
+static constexpr size_t ALIGNMENT = 16;
+struct vfloat {
+  float32x4_t v;
+};
+struct vuint {
+  uint32x4_t v;
+};
+struct vmask {
+  uint32x4_t v;
+};
+inline vfloat load(const float *p) { return {vld1q_f32(p)}; }
+inline void store(float *p, vfloat a) { vst1q_f32(p, a.v); }
+inline vuint load(const uint32_t *p) { return {vld1q_u32(p)}; }
+inline void store(uint32_t *p, vuint a) { vst1q_u32(p, a.v); }
+inline vfloat broadcast(float x) { return {vdupq_n_f32(x)}; }
+inline vfloat operator+(vfloat a, vfloat b) { return {vaddq_f32(a.v, b.v)}; }
+inline vfloat operator-(vfloat a, vfloat b) { return {vsubq_f32(a.v, b.v)}; }
+inline vfloat operator*(vfloat a, vfloat b) { return {vmulq_f32(a.v, b.v)}; }
+#if defined(__aarch64__)
+inline vfloat operator/(vfloat a, vfloat b) { return {vdivq_f32(a.v, b.v)}; }
+#else
+// armv7 has no vector divide; two Newton steps on the reciprocal estimate are
+// within a couple of ulp of the scalar quotient
+inline vfloat operator/(vfloat a, vfloat b) {
+  float32x4_t r = vrecpeq_f32(b.v);
+  r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+  r = vmulq_f32(vrecpsq_f32(b.v, r), r);
+  return {vmulq_f32(a.v, r)};
+}
+#endif
+inline vfloat min(vfloat a, vfloat b) { return {vminq_f32(a.v, b.v)}; }
+inline vfloat max(vfloat a, vfloat b) { return {vmaxq_f32(a.v, b.v)}; }
+inline vmask lessThan(vfloat a, vfloat b) { return {vcltq_f32(a.v, b.v)}; }
+inline vmask greaterThan(vfloat a, vfloat b) { return {vcgtq_f32(a.v, b.v)}; }
+inline vmask greaterEqual(vfloat a, vfloat b) {
+  return {vcgeq_f32(a.v, b.v)};
+}
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+  return {vbslq_f32(m.v, a.v, b.v)};
+}
+inline vuint operator^(vuint a, vuint b) { return {veorq_u32(a.v, b.v)}; }
+inline vuint shiftLeft(vuint a, int n) {
+  return {vshlq_u32(a.v, vdupq_n_s32(n))};
+}
+inline vuint shiftRight(vuint a, int n) {
+  return {vshlq_u32(a.v, vdupq_n_s32(-n))};
+}
+inline vfloat toSignedFloat(vuint a) {
+  return {vcvtq_f32_s32(vreinterpretq_s32_u32(a.v))};
+}
+inline vfloat loadInt16(const int16_t *p) {
+  return {vcvtq_f32_s32(vmovl_s16(vld1_s16(p)))};
+}
+
+#else
+static constexpr size_t LANES = 4;
+static constexpr size_t ALIGNMENT = 16;
+struct vfloat {
+  float v[LANES];
+};
+struct vuint {
+  uint32_t v[LANES];
+};
+struct vmask {
+  bool v[LANES];
+};
+#define SIMD_LANEWISE(expression)                                              \
+  for (size_t i = 0; i < LANES; ++i) {                                         \
+    expression;                                                                \
+  }
+inline vfloat load(const float *p) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = p[i]);
+  return r;
+}
+inline void store(float *p, vfloat a) { SIMD_LANEWISE(p[i] = a.v[i]); }
+inline vuint load(const uint32_t *p) {
+  vuint r;
+  SIMD_LANEWISE(r.v[i] = p[i]);
+  return r;
+}
+inline void store(uint32_t *p, vuint a) { SIMD_LANEWISE(p[i] = a.v[i]); }
+inline vfloat broadcast(float x) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = x);
+  return r;
+}
+#define SIMD_BINARY_OPERATOR(op)                                               \
+  inline vfloat operator op(vfloat a, vfloat b) {                              \
+    vfloat r;                                                                  \
+    SIMD_LANEWISE(r.v[i] = a.v[i] op b.v[i]);                                  \
+    return r;                                                                  \
+  }
+SIMD_BINARY_OPERATOR(+)
+SIMD_BINARY_OPERATOR(-)
+SIMD_BINARY_OPERATOR(*)
+SIMD_BINARY_OPERATOR(/)
+#undef SIMD_BINARY_OPERATOR
+inline vfloat min(vfloat a, vfloat b) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]);
+  return r;
+}
+inline vfloat max(vfloat a, vfloat b) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]);
+  return r;
+}
+inline vmask lessThan(vfloat a, vfloat b) {
+  vmask r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] < b.v[i]);
+  return r;
+}
+inline vmask greaterThan(vfloat a, vfloat b) {
+  vmask r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] > b.v[i]);
+  return r;
+}
+inline vmask greaterEqual(vfloat a, vfloat b) {
+  vmask r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] >= b.v[i]);
+  return r;
+}
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = m.v[i] ? a.v[i] : b.v[i]);
+  return r;
+}
+inline vuint operator^(vuint a, vuint b) {
+  vuint r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] ^ b.v[i]);
+  return r;
+}
+inline vuint shiftLeft(vuint a, int n) {
+  vuint r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] << n);
+  return r;
+}
+inline vuint shiftRight(vuint a, int n) {
+  vuint r;
+  SIMD_LANEWISE(r.v[i] = a.v[i] >> n);
+  return r;
+}
+inline vfloat toSignedFloat(vuint a) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = float(int32_t(a.v[i])));
+  return r;
+}
+inline vfloat loadInt16(const int16_t *p) {
+  vfloat r;
+  SIMD_LANEWISE(r.v[i] = float(p[i]));
+  return r;
+}
+#undef SIMD_LANEWISE
+#endif
+
+// scalar overloads so kernels can be instantiated one lane at a time
+template <typename T> inline T min(T a, T b) { return a < b ? a : b; }
+template <typename T> inline T max(T a, T b) { return a > b ? a : b; }
+template <typename T> inline bool lessThan(T a, T b) { return a < b; }
+template <typename T> inline bool greaterThan(T a, T b) { return a > b; }
+template <typename T> inline bool greaterEqual(T a, T b) { return a >= b; }
+template <typename T> inline T select(bool m, T a, T b) { return m ? a : b; }
+inline uint32_t shiftLeft(uint32_t a, int n) { return a << n; }
+inline uint32_t shiftRight(uint32_t a, int n) { return a >> n; }
+inline float toSignedFloat(uint32_t a) { return float(int32_t(a)); }
+
+template <typename V> inline V splat(float x) { return V(x); }
+template <> inline vfloat splat<vfloat>(float x) { return broadcast(x); }
+
+inline constexpr size_t roundUpToLanes(size_t n) {
+  return ((n + LANES - 1) / LANES) * LANES;
+}
+
+} // namespace simd
@@ -1,5 +1,8 @@
 #pragma once
 #include "SDL_log.h"
+#include "SDL_timer.h"
+#include "event_bus.h"
+#include "parameter_channel.h"
 #include "synthesis_frequency_modulation.h"
 #include "synthesis_mixing.h"
 #include "synthesis_parameter.h"
@@ -7,13 +10,14 @@
 #include "synthesis_sampling.h"
 #include "synthesis_subtractive.h"
 #include "synthesizer_settings.h"
+#include "triple_buffer.h"
 #include <algae.h>
 #include <atomic>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <new>
-#include <rigtorp/SPSCQueue.h>
 
 template <typename sample_t> struct PitchBendEvent {
   sample_t note = 0;
@@ -25,6 +29,9 @@ template <typename sample_t> struct ParameterChangeEvent {
 };
 template <typename sample_t> struct GateEvent {
   sample_t value;
+  int voiceKey = 0;
+  // the note's own FREQUENCY; 0 plays it at the current one
+  sample_t frequency = 0;
 };
 template <typename sample_t> struct SynthesizerEvent {
   enum EventType {
@@ -43,6 +50,9 @@ template <typename sample_t> struct SynthesizerEvent {
     uEventData(const SynthesizerType &s) : newSynthType(s) {}
     uEventData(const PitchBendEvent<sample_t> &b) : pitchBend(b) {}
   } data;
+  // frame on the synthesizer's render clock at which the event takes effect;
+  // anything at or before the current frame is applied at the block start
+  uint64_t frame = 0;
   SynthesizerEvent<sample_t>() {}
   SynthesizerEvent<sample_t>(const GateEvent<sample_t> &gateEvent)
       : data(gateEvent), type(GATE) {}
@@ -55,346 +65,543 @@ template <typename sample_t> struct SynthesizerEvent {
       : data(bend), type(PITCH_BEND) {}
 };
 
+// The synthesizer's state at the end of the audio thread's last block, handed
+// to the UI through a TripleBuffer so drawing never reads audio-owned state
+// directly. parameters are the targets the engine was last given, and
+// smoothedParameters how far the focused voice's own smoothing has got
+// toward them. Voice stages and levels come from the voice allocator;
+// envelopeStages are each voice's engine envelope.
+template <typename sample_t> struct SynthesizerReadback {
+  SynthesizerType type = SUBTRACTIVE_DRUM_SYNTH;
+  uint64_t frame = 0;
+  ParameterSnapshot<sample_t> parameters;
+  ParameterSnapshot<sample_t> smoothedParameters;
+  size_t numActiveVoices = 0;
+  VoiceStage voiceStages[DEFAULT_MAX_VOICES] = {};
+  EnvelopeStage envelopeStages[DEFAULT_MAX_VOICES] = {};
+  sample_t voiceLevels[DEFAULT_MAX_VOICES] = {};
+};
+
+template <typename sample_t>
+using PolyphonicDrumSynth =
+    PolyphonicSynthesizer<sample_t, SubtractiveDrumSynth<sample_t>>;
+template <typename sample_t>
+using PolyphonicSubtractiveSynth =
+    PolyphonicSynthesizer<sample_t, SubtractiveSynthesizer<sample_t>>;
+template <typename sample_t>
+using PolyphonicPhysicalModel =
+    PolyphonicSynthesizer<sample_t, KarplusStrongSynthesizer<sample_t>>;
+template <typename sample_t>
+using PolyphonicFMSynth =
+    PolyphonicSynthesizer<sample_t, FMSynthesizer<sample_t>>;
+template <typename sample_t>
+using PolyphonicSampler = PolyphonicSynthesizer<sample_t, Sampler<sample_t>>;
+
 template <typename sample_t> struct Synthesizer {
   const float MIN_FREQUENCY = mtof(24);
   const float MAX_FREQUENCY = mtof(40 + 6 * 5);
-  std::atomic<sample_t> frequency = 440;
-  std::atomic<sample_t> gain = 1;
-  std::atomic<sample_t> filterCutoff = 1;
-  std::atomic<sample_t> filterQuality = 0.3;
-  std::atomic<sample_t> soundSource = 0;
-  std::atomic<sample_t> attackTime = 0;
-  std::atomic<sample_t> releaseTime = 1;
-  std::atomic<sample_t> octave = 0;
+  ParameterSnapshot<sample_t> parameters;
+  ParameterSnapshot<sample_t> appliedParameters;
+  // the reader side of the triple buffer swaps indices, hence mutable; it is
+  // only ever read from the UI thread
+  mutable TripleBuffer<SynthesizerReadback<sample_t>> readback;
 
   sample_t sampleRate = 48000;
-  SampleBank<sample_t> *sampleBank = NULL;
+  // render clock: audio-owned frame counter plus the offset producers use to
+  // turn wall-clock time into a frame. schedulingLatency is one callback, so
+  // an event stamped anywhere during a callback lands in the next one at the
+  // same relative position
+  uint64_t renderedFrames = 0;
+  std::atomic<double> frameClockOffset = 0;
+  std::atomic<uint32_t> schedulingLatency = 0;
+  static constexpr double MAX_SCHEDULE_AHEAD_SECONDS = 1.0;
+  SampleLibrary<sample_t> *sampleLibrary = NULL;
   Arena *delayTimeArena = NULL;
-  KarplusStrongSynthesizer<sample_t> physicalModel;
+  PolyphonicPhysicalModel<sample_t> physicalModel;
 
   SynthesizerType type;
   union uSynthesizer {
-    SubtractiveDrumSynth<sample_t> subtractiveDrumSynth;
-    SubtractiveSynthesizer<sample_t> subtractive;
-    FMSynthesizer<sample_t> fm;
-    Sampler<sample_t> sampler;
-    uSynthesizer(const SubtractiveDrumSynth<sample_t> &s)
+    PolyphonicDrumSynth<sample_t> subtractiveDrumSynth;
+    PolyphonicSubtractiveSynth<sample_t> subtractive;
+    PolyphonicFMSynth<sample_t> fm;
+    PolyphonicSampler<sample_t> sampler;
+    uSynthesizer(const PolyphonicDrumSynth<sample_t> &s)
         : subtractiveDrumSynth(s) {}
-    uSynthesizer(const SubtractiveSynthesizer<sample_t> &s) : subtractive(s) {}
-    // uSynthesizer(const KarplusStrongSynthesizer<sample_t> &s)
-    //     : physicalModel(s) {}
-    uSynthesizer(const FMSynthesizer<sample_t> &s) : fm(s) {}
-    uSynthesizer(const Sampler<sample_t> &s) : sampler(s) {}
+    uSynthesizer(const PolyphonicSubtractiveSynth<sample_t> &s)
+        : subtractive(s) {}
+    uSynthesizer(const PolyphonicFMSynth<sample_t> &s) : fm(s) {}
+    uSynthesizer(const PolyphonicSampler<sample_t> &s) : sampler(s) {}
   } object;
 
-  rigtorp::SPSCQueue<SynthesizerEvent<sample_t>> eventQueue =
-      rigtorp::SPSCQueue<SynthesizerEvent<sample_t>>(20);
+  // Discrete events: gates, engine changes, bends, and parameter changes
+  // scripted with pushEventAt. Each producer that may run on its own thread
+  // registers a lane; the rest share uiLane. Live parameter moves go through
+  // parameterChannel instead, which any thread may send to, so a sensor
+  // burst cannot fill a lane. A note's pitch is not a parameter move: it
+  // travels in its gate, so two notes sent in one block keep their pitches.
+  typedef typename EventBus<SynthesizerEvent<sample_t>>::Lane EventLane;
+  EventBus<SynthesizerEvent<sample_t>> eventBus{64};
+  EventLane *uiLane = NULL;
+  ParameterChannel<sample_t> parameterChannel;
+  // received from parameterChannel but not due yet; audio thread only
+  sample_t pendingParameterValues[NUM_PARAMETER_TYPES] = {};
+  uint64_t pendingParameterFrames[NUM_PARAMETER_TYPES] = {};
+  uint32_t pendingParameters = 0;
 
-  Synthesizer<sample_t>(SampleBank<sample_t> *bank, Arena *_delayTimeArena,
+  Synthesizer<sample_t>(SampleLibrary<sample_t> *library,
+                        Arena *_delayTimeArena,
                         const SynthesizerSettings &synthesizerSettings)
-      : sampleBank(bank), delayTimeArena(_delayTimeArena),
-        object(SubtractiveDrumSynth<sample_t>()),
-        type(synthesizerSettings.synthType),
-        physicalModel(KarplusStrongSynthesizer<sample_t>(_delayTimeArena)) {
-    gain = synthesizerSettings.gain;
-    octave = synthesizerSettings.octave;
-    filterCutoff = synthesizerSettings.filterCutoff;
-    filterQuality = synthesizerSettings.filterQuality;
-    soundSource = synthesizerSettings.soundSource;
-    attackTime = synthesizerSettings.attack;
-    releaseTime = synthesizerSettings.release;
+      : sampleLibrary(library), delayTimeArena(_delayTimeArena),
+        object(PolyphonicDrumSynth<sample_t>()),
+        type(synthesizerSettings.synthType), physicalModel(_delayTimeArena) {
+    uiLane = eventBus.registerProducer("ui");
+    parameters[FREQUENCY] = 440;
+    parameters[GAIN] = synthesizerSettings.gain;
+    parameters[SOUND_SOURCE] = synthesizerSettings.soundSource;
+    parameters[FILTER_CUTOFF] = synthesizerSettings.filterCutoff;
+    parameters[FILTER_QUALITY] = synthesizerSettings.filterQuality;
+    parameters[ATTACK_TIME] = synthesizerSettings.attack;
+    parameters[RELEASE_TIME] = synthesizerSettings.release;
+    parameters[OCTAVE] = synthesizerSettings.octave;
+    invalidateAppliedParameters();
+    SynthesizerReadback<sample_t> initialState;
+    initialState.type = type;
+    initialState.parameters = parameters;
+    initialState.smoothedParameters = parameters;
+    readback.reset(initialState);
+  }
+
+  // called once at the top of every audio callback to anchor the render clock
+  // to wall-clock time
+  inline void beginCallback(const size_t numFrames) {
+    const double now = double(SDL_GetPerformanceCounter()) /
+                       double(SDL_GetPerformanceFrequency());
+    frameClockOffset.store(double(renderedFrames) - now * sampleRate,
+                           std::memory_order_relaxed);
+    schedulingLatency.store(uint32_t(numFrames), std::memory_order_relaxed);
   }
 
+  // renders blockSize frames, splitting the block wherever a queued event is
+  // due so gates and parameter changes land on the frame they were stamped for
   inline const void process(sample_t *block, const size_t &blockSize) {
-    consumeMessagesFromQueue();
-    for (size_t i = 0; i < blockSize; i++) {
-      block[i] = computeNextSample();
+    eventBus.sampleDepths();
+    pendingParameters |= parameterChannel.receive(pendingParameterValues,
+                                                  pendingParameterFrames);
+    size_t offset = 0;
+    while (offset < blockSize) {
+      // parameters first, so a note sees a FREQUENCY due on its own frame
+      const size_t segmentSize =
+          consumeMessagesFromQueue(consumeDueParameters(blockSize - offset));
+      applyParameterChanges();
+      sample_t *segment = block + offset;
+      visitActiveEngine([segment, segmentSize](auto &engine) {
+        engine.process(segment, segmentSize);
+      });
+      offset += segmentSize;
+      renderedFrames += segmentSize;
+    }
+    if (sampleLibrary != NULL) {
+      sampleLibrary->reportOldestInUse(oldestSampleGenerationInUse());
     }
+    publishReadback();
+  }
+
+  // the oldest bank a sounding sampler voice still plays from, or the
+  // current one; banks older than this can be freed
+  inline const uint64_t oldestSampleGenerationInUse() const {
+    uint64_t oldest = sampleLibrary->currentGeneration();
+    if (type != SAMPLER) {
+      return oldest;
+    }
+    const PolyphonicSampler<sample_t> &sampler = object.sampler;
+    for (size_t i = 0; i < sampler.allocator.numActiveVoices; ++i) {
+      const SampleBank<sample_t> *bank =
+          sampler.voices[sampler.allocator.activeVoices[i]].voice.sampleBank;
+      if (bank != NULL && bank->generation < oldest) {
+        oldest = bank->generation;
+      }
+    }
+    return oldest;
+  }
+
+  // once per block: hand the UI a consistent picture of the targets and of
+  // what the engine is playing
+  inline void publishReadback() {
+    SynthesizerReadback<sample_t> &state = readback.writeBuffer();
+    state.type = type;
+    state.frame = renderedFrames;
+    state.parameters = parameters;
+    // voices smooth the pitch OCTAVE moved them to, so FREQUENCY is read in
+    // that register and moved back
+    const sample_t pitch = enginePitch(parameters);
+    state.smoothedParameters = parameters;
+    state.smoothedParameters[FREQUENCY] = pitch;
+    visitActiveEngine([&state](auto &engine) {
+      state.numActiveVoices = engine.readVoices(
+          state.voiceStages, state.envelopeStages, state.voiceLevels);
+      engine.readSmoothedParameters(state.smoothedParameters);
+    });
+    if (pitch > 0) {
+      state.smoothedParameters[FREQUENCY] *= parameters[FREQUENCY] / pitch;
+    }
+    readback.publish();
   }
 
   inline const sample_t next() {
-    consumeMessagesFromQueue();
-    return computeNextSample();
+    sample_t out = 0;
+    process(&out, 1);
+    return out;
   }
 
-  inline const sample_t computeNextSample() {
-    static const sample_t octaveMultiples[6] = {0.25, 0.5, 1.0, 2.0, 4.0, 8.0};
-    auto registerMultiplier = octaveMultiples[int(
-        algae::dsp::math::clamp<sample_t>(octave * 6, 0.0, 5.0))];
-    auto nextFrequency = frequency * registerMultiplier;
+  template <typename VisitorT> inline void visitActiveEngine(VisitorT visitor) {
     switch (type) {
-
-    case SUBTRACTIVE_DRUM_SYNTH: {
-      object.subtractiveDrumSynth.setFrequency(nextFrequency);
-      object.subtractiveDrumSynth.setGain(gain);
-      object.subtractiveDrumSynth.setFilterCutoff(filterCutoff);
-      object.subtractiveDrumSynth.setFilterQuality(filterQuality);
-      object.subtractiveDrumSynth.setSoundSource(soundSource);
-      object.subtractiveDrumSynth.setAttackTime(attackTime);
-      object.subtractiveDrumSynth.setReleaseTime(releaseTime);
-      return object.subtractiveDrumSynth.next();
+    case SUBTRACTIVE_DRUM_SYNTH:
+      visitor(object.subtractiveDrumSynth);
       break;
-    }
-    case SUBTRACTIVE: {
-      object.subtractive.setFrequency(nextFrequency);
-      object.subtractive.setGain(gain);
-      object.subtractive.setFilterCutoff(filterCutoff);
-      object.subtractive.setFilterQuality(filterQuality);
-      object.subtractive.setSoundSource(soundSource);
-      object.subtractive.setAttackTime(attackTime);
-      object.subtractive.setReleaseTime(releaseTime);
-      return object.subtractive.next();
+    case SUBTRACTIVE:
+      visitor(object.subtractive);
       break;
-    }
-    case PHYSICAL_MODEL: {
-      physicalModel.setFrequency(nextFrequency);
-      physicalModel.setGain(gain);
-      physicalModel.setFilterCutoff(filterCutoff);
-      physicalModel.setFilterQuality(filterQuality);
-      physicalModel.setSoundSource(soundSource);
-      physicalModel.setAttackTime(attackTime);
-      physicalModel.setReleaseTime(releaseTime);
-      return physicalModel.next();
+    case PHYSICAL_MODEL:
+      visitor(physicalModel);
       break;
-    }
-    case FREQUENCY_MODULATION: {
-      object.fm.setFrequency(nextFrequency);
-      object.fm.setGain(gain);
-      object.fm.setFilterCutoff(filterCutoff);
-      object.fm.setFilterQuality(filterQuality);
-      object.fm.setSoundSource(soundSource);
-      object.fm.setAttackTime(attackTime);
-      object.fm.setReleaseTime(releaseTime);
-      return object.fm.next();
+    case FREQUENCY_MODULATION:
+      visitor(object.fm);
       break;
-    }
-    case SAMPLER: {
-      object.sampler.setFrequency(nextFrequency);
-      object.sampler.setGain(gain);
-      object.sampler.setFilterCutoff(filterCutoff);
-      object.sampler.setFilterQuality(filterQuality);
-      object.sampler.setSoundSource(soundSource);
-      object.sampler.setAttackTime(attackTime);
-      object.sampler.setReleaseTime(releaseTime);
-      return object.sampler.next();
+    case SAMPLER:
+      visitor(object.sampler);
       break;
     }
+  }
+
+  // forces the next applyParameterChanges to hand every value to the engine,
+  // e.g. after an engine switch
+  inline void invalidateAppliedParameters() {
+    for (auto parameterType : ParameterTypes) {
+      appliedParameters[parameterType] = NAN;
     }
-    return 0;
   }
 
-  inline void consumeMessagesFromQueue() {
-    while (!eventQueue.empty()) {
-      SynthesizerEvent<sample_t> event = *eventQueue.front();
-      eventQueue.pop();
+  // FREQUENCY moved into the register OCTAVE selects; what engines play
+  inline const sample_t
+  enginePitch(const ParameterSnapshot<sample_t> &p) const {
+    static const sample_t octaveMultiples[6] = {0.25, 0.5, 1.0, 2.0, 4.0, 8.0};
+    return p[FREQUENCY] *
+           octaveMultiples[int(
+               algae::dsp::math::clamp<sample_t>(p[OCTAVE] * 6, 0.0, 5.0))];
+  }
 
-      switch (event.type) {
-      case SynthesizerEvent<sample_t>::SYNTHESIZER_CHANGE: {
-        switch (event.data.newSynthType) {
-        case SUBTRACTIVE_DRUM_SYNTH: {
-          type = SUBTRACTIVE_DRUM_SYNTH;
-          object.subtractiveDrumSynth = SubtractiveDrumSynth<sample_t>();
-          break;
-        }
-        case SUBTRACTIVE: {
-          type = SUBTRACTIVE;
-          object.subtractive = SubtractiveSynthesizer<sample_t>();
-          break;
-        }
-        case PHYSICAL_MODEL: {
-          type = PHYSICAL_MODEL;
-          //  delayTimeArena->clear();
-          //  physicalModel =
-          //      KarplusStrongSynthesizer<sample_t>(delayTimeArena);
-          break;
-        }
-        case FREQUENCY_MODULATION: {
-          type = FREQUENCY_MODULATION;
-          object.fm = FMSynthesizer<sample_t>();
-          break;
-        }
-        case SAMPLER: {
-          type = SAMPLER;
-          object.sampler = Sampler<sample_t>(sampleBank);
-          break;
-        }
-        }
+  // engines only hear about parameters that changed since the last block
+  inline void applyParameterChanges() {
+    bool changed[NUM_PARAMETER_TYPES];
+    bool anyChanged = false;
+    for (auto parameterType : ParameterTypes) {
+      changed[parameterType] =
+          !(parameters[parameterType] == appliedParameters[parameterType]);
+      anyChanged |= changed[parameterType];
+    }
+    if (!anyChanged)
+      return;
+
+    const ParameterSnapshot<sample_t> &p = parameters;
+    const sample_t pitch = enginePitch(p);
+    visitActiveEngine([&p, &changed, pitch](auto &engine) {
+      if (changed[FREQUENCY] || changed[OCTAVE]) {
+        engine.setFrequency(pitch);
+      }
+      if (changed[GAIN])
+        engine.setGain(p[GAIN]);
+      if (changed[FILTER_CUTOFF])
+        engine.setFilterCutoff(p[FILTER_CUTOFF]);
+      if (changed[FILTER_QUALITY])
+        engine.setFilterQuality(p[FILTER_QUALITY]);
+      if (changed[SOUND_SOURCE])
+        engine.setSoundSource(p[SOUND_SOURCE]);
+      if (changed[ATTACK_TIME])
+        engine.setAttackTime(p[ATTACK_TIME]);
+      if (changed[RELEASE_TIME])
+        engine.setReleaseTime(p[RELEASE_TIME]);
+    });
+
+    for (auto parameterType : ParameterTypes) {
+      if (changed[parameterType]) {
+        appliedParameters[parameterType] = parameters[parameterType];
+      }
+    }
+  }
+
+  // how far ahead of the render clock an event may be stamped before its
+  // producer's clock counts as stale
+  inline const uint64_t maxScheduleAhead() const {
+    return uint64_t(MAX_SCHEDULE_AHEAD_SECONDS * sampleRate);
+  }
+
+  // applies every event that is due at the current frame, in frame order
+  // across all lanes, and returns how many frames (at most maxFrames) can be
+  // rendered before the next one is. Events further ahead than
+  // maxScheduleAhead() are treated as a stale clock and applied immediately
+  // rather than holding up the queue
+  inline const size_t consumeMessagesFromQueue(const size_t maxFrames) {
+    const uint64_t horizon = maxScheduleAhead();
+    while (EventLane *lane = eventBus.earliest(renderedFrames, horizon)) {
+      const SynthesizerEvent<sample_t> *pending = lane->queue.front();
+      if (pending->frame > renderedFrames &&
+          pending->frame - renderedFrames <= horizon) {
+        const uint64_t framesUntilDue = pending->frame - renderedFrames;
+        return framesUntilDue < maxFrames ? size_t(framesUntilDue) : maxFrames;
+      }
+      SynthesizerEvent<sample_t> event = *pending;
+      lane->queue.pop();
+      handleEvent(event);
+    }
+    return maxFrames;
+  }
+
+  // the parameter counterpart of consumeMessagesFromQueue: takes every
+  // pending value that is due and shortens maxFrames to the next one
+  inline const size_t consumeDueParameters(const size_t maxFrames) {
+    size_t frames = maxFrames;
+    const uint64_t horizon = maxScheduleAhead();
+    for (auto parameterType : ParameterTypes) {
+      const uint32_t bit = uint32_t(1) << parameterType;
+      if (!(pendingParameters & bit)) {
+        continue;
+      }
+      const uint64_t frame = pendingParameterFrames[parameterType];
+      if (frame > renderedFrames &&
+          frame - renderedFrames <= horizon) {
+        const uint64_t framesUntilDue = frame - renderedFrames;
+        frames = framesUntilDue < frames ? size_t(framesUntilDue) : frames;
+        continue;
+      }
+      parameters[parameterType] = pendingParameterValues[parameterType];
+      pendingParameters &= ~bit;
+    }
+    return frames;
+  }
+
+  inline void handleEvent(const SynthesizerEvent<sample_t> &event) {
+    switch (event.type) {
+    case SynthesizerEvent<sample_t>::SYNTHESIZER_CHANGE: {
+      switch (event.data.newSynthType) {
+      case SUBTRACTIVE_DRUM_SYNTH: {
+        type = SUBTRACTIVE_DRUM_SYNTH;
+        object.subtractiveDrumSynth = PolyphonicDrumSynth<sample_t>();
         break;
       }
-      case SynthesizerEvent<sample_t>::GATE: {
-        switch (type) {
-        case SUBTRACTIVE_DRUM_SYNTH:
-          object.subtractiveDrumSynth.setGate(event.data.gate.value);
-          break;
-        case SUBTRACTIVE:
-          object.subtractive.setGate(event.data.gate.value);
-          break;
-        case PHYSICAL_MODEL:
-          physicalModel.setGate(event.data.gate.value);
-          break;
-        case FREQUENCY_MODULATION:
-          object.fm.setGate(event.data.gate.value);
-          break;
-        case SAMPLER:
-          object.sampler.setGate(event.data.gate.value);
-          break;
-        }
+      case SUBTRACTIVE: {
+        type = SUBTRACTIVE;
+        object.subtractive = PolyphonicSubtractiveSynth<sample_t>();
         break;
       }
-      case SynthesizerEvent<sample_t>::PARAMETER_CHANGE: {
-        auto value = event.data.paramChange.value;
-        switch (event.data.paramChange.type) {
-        case FREQUENCY: {
-          frequency = value;
-          break;
-        }
-        case GAIN: {
-          gain = value;
-          break;
-        }
-        case SOUND_SOURCE: {
-          soundSource = value;
-          break;
-        }
-        case FILTER_CUTOFF: {
-          filterCutoff = value;
-          break;
-        }
-        case FILTER_QUALITY: {
-          filterQuality = value;
-          break;
-        }
-        case ATTACK_TIME: {
-          attackTime = value;
-          break;
-        }
-        case RELEASE_TIME: {
-          releaseTime = value;
-          break;
-        }
-        case OCTAVE: {
-          octave = value;
-          break;
-        }
-        }
+      case PHYSICAL_MODEL: {
+        type = PHYSICAL_MODEL;
+        //  delayTimeArena->clear();
+        //  physicalModel =
+        //      KarplusStrongSynthesizer<sample_t>(delayTimeArena);
         break;
       }
-      case SynthesizerEvent<sample_t>::PITCH_BEND: {
-        switch (type) {
-        case SUBTRACTIVE_DRUM_SYNTH: {
-          object.subtractiveDrumSynth.bendNote(
-              event.data.pitchBend.note, event.data.pitchBend.destinationNote);
-          break;
-        }
-        case SUBTRACTIVE: {
-          object.subtractive.bendNote(event.data.pitchBend.note,
-                                      event.data.pitchBend.destinationNote);
-          break;
-        }
-        case PHYSICAL_MODEL: {
-          physicalModel.bendNote(event.data.pitchBend.note,
-                                 event.data.pitchBend.destinationNote);
-          break;
-        }
-        case FREQUENCY_MODULATION: {
-          object.fm.bendNote(event.data.pitchBend.note,
-                             event.data.pitchBend.destinationNote);
-          break;
-        }
-        case SAMPLER: {
-          object.sampler.bendNote(event.data.pitchBend.note,
-                                  event.data.pitchBend.destinationNote);
-          break;
-        }
+      case FREQUENCY_MODULATION: {
+        type = FREQUENCY_MODULATION;
+        object.fm = PolyphonicFMSynth<sample_t>();
+        break;
+      }
+      case SAMPLER: {
+        type = SAMPLER;
+        object.sampler = PolyphonicSampler<sample_t>(sampleLibrary);
+        break;
+      }
+      }
+      invalidateAppliedParameters();
+      break;
+    }
+    case SynthesizerEvent<sample_t>::GATE: {
+      // a note takes the pitch in effect at its own frame, so it never
+      // sounds at the previous note's pitch first
+      const GateEvent<sample_t> gate = event.data.gate;
+      if (gate.value > 0 && gate.frequency > 0) {
+        parameters[FREQUENCY] = gate.frequency;
+      }
+      const sample_t pitch = enginePitch(parameters);
+      visitActiveEngine([&gate, pitch](auto &engine) {
+        if (gate.value > 0) {
+          engine.noteOn(gate.voiceKey, pitch, gate.value);
+        } else {
+          engine.noteOff(gate.voiceKey);
         }
+      });
+      break;
+    }
+    case SynthesizerEvent<sample_t>::PARAMETER_CHANGE: {
+      auto parameterType = event.data.paramChange.type;
+      if (parameterType < NUM_PARAMETER_TYPES) {
+        parameters[parameterType] = event.data.paramChange.value;
+      }
+      break;
+    }
+    case SynthesizerEvent<sample_t>::PITCH_BEND: {
+      switch (type) {
+      case SUBTRACTIVE_DRUM_SYNTH: {
+        object.subtractiveDrumSynth.bendNote(
+            event.data.pitchBend.note, event.data.pitchBend.destinationNote);
         break;
       }
+      case SUBTRACTIVE: {
+        object.subtractive.bendNote(event.data.pitchBend.note,
+                                    event.data.pitchBend.destinationNote);
+        break;
+      }
+      case PHYSICAL_MODEL: {
+        physicalModel.bendNote(event.data.pitchBend.note,
+                               event.data.pitchBend.destinationNote);
+        break;
+      }
+      case FREQUENCY_MODULATION: {
+        object.fm.bendNote(event.data.pitchBend.note,
+                           event.data.pitchBend.destinationNote);
+        break;
+      }
+      case SAMPLER: {
+        object.sampler.bendNote(event.data.pitchBend.note,
+                                event.data.pitchBend.destinationNote);
+        break;
       }
+      }
+      break;
     }
+    }
+  }
+
+  // wall-clock now, mapped onto the render clock one callback ahead
+  inline const uint64_t scheduleFrame() const {
+    const double now = double(SDL_GetPerformanceCounter()) /
+                       double(SDL_GetPerformanceFrequency());
+    const double frame = now * sampleRate +
+                         frameClockOffset.load(std::memory_order_relaxed) +
+                         schedulingLatency.load(std::memory_order_relaxed);
+    return frame > 0 ? uint64_t(frame) : 0;
+  }
+
+  // producers that may run on a thread of their own, like the sequencer or
+  // the game, register once and pass their lane along with every event
+  inline EventLane *registerEventProducer(const char *name) {
+    return eventBus.registerProducer(name);
   }
 
+  // A full lane is counted and then waited out rather than dropping the
+  // event, since a lost gate would leave a note hanging. Without a lane the
+  // event goes on uiLane.
+  inline void pushEvent(SynthesizerEvent<sample_t> event,
+                        EventLane *lane = NULL) {
+    event.frame = scheduleFrame();
+    eventBus.push(lane != NULL ? lane : uiLane, event);
+  }
+
+  // for scripted playback that already knows the exact frame; fails instead
+  // of blocking when uiLane is full
+  inline const bool pushEventAt(SynthesizerEvent<sample_t> event,
+                                const uint64_t frame) {
+    event.frame = frame;
+    return uiLane->queue.try_push(event);
+  }
+
+  // only the latest value per parameter reaches the audio thread
   inline void pushParameterChangeEvent(ContinuousParameterType type,
                                        sample_t value) {
-    eventQueue.push(
-        ParameterChangeEvent<sample_t>{.type = type, .value = value});
+    parameterChannel.send(type, value, scheduleFrame());
   }
 
-  inline void pushGateEvent(MomentaryParameterType type, sample_t value) {
-    eventQueue.push(GateEvent<sample_t>{.value = value});
+  // frequency is the note's pitch before OCTAVE, for producers whose notes
+  // each have their own; 0 plays the note at the current FREQUENCY
+  inline void pushGateEvent(MomentaryParameterType type, sample_t value,
+                            int voiceKey = 0, EventLane *lane = NULL,
+                            sample_t frequency = 0) {
+    pushEvent(GateEvent<sample_t>{.value = value,
+                                  .voiceKey = voiceKey,
+                                  .frequency = frequency},
+              lane);
   }
 
   inline void setSynthType(SynthesizerType type) {
-    eventQueue.push(SynthesizerEvent<sample_t>(type));
+    pushEvent(SynthesizerEvent<sample_t>(type));
+  }
+
+  // UI-side accessors; all of them read the latest published readback
+
+  inline const SynthesizerReadback<sample_t> &getReadback() const {
+    return readback.latest();
   }
 
-  inline SynthesizerType getSynthType() const { return type; }
+  inline SynthesizerType getSynthType() const { return getReadback().type; }
+
+  inline const uint32_t getEventQueueOverflows() const {
+    return eventBus.totalOverflows();
+  }
+
+  inline const uint32_t getCoalescedParameterChanges() const {
+    return parameterChannel.coalesced.load(std::memory_order_relaxed);
+  }
 
   inline void setFrequency(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = FREQUENCY, .value = value}));
+    pushParameterChangeEvent(FREQUENCY, value);
   }
 
   inline void setSoundSource(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = SOUND_SOURCE, .value = value}));
+    pushParameterChangeEvent(SOUND_SOURCE, value);
   }
 
   inline void setGain(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = GAIN, .value = value}));
+    pushParameterChangeEvent(GAIN, value);
   }
 
   inline void setFilterCutoff(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = FILTER_CUTOFF, .value = value}));
+    pushParameterChangeEvent(FILTER_CUTOFF, value);
   }
 
   inline void setFilterQuality(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(ParameterChangeEvent<sample_t>{
-        .type = FILTER_QUALITY, .value = value}));
+    pushParameterChangeEvent(FILTER_QUALITY, value);
   }
 
   inline void setAttackTime(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = ATTACK_TIME, .value = value}));
+    pushParameterChangeEvent(ATTACK_TIME, value);
   }
 
   inline void setReleaseTime(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = RELEASE_TIME, .value = value}));
+    pushParameterChangeEvent(RELEASE_TIME, value);
   }
 
   inline void setOctave(sample_t value) {
-    eventQueue.push(SynthesizerEvent<sample_t>(
-        ParameterChangeEvent<sample_t>{.type = OCTAVE, .value = value}));
+    pushParameterChangeEvent(OCTAVE, value);
   }
 
   inline const sample_t
-  getParameter(const ContinuousParameterType parameterType) const {
-
-    // TODO this also needs better threading consideration
+  normalizedParameter(const ContinuousParameterType parameterType,
+                      const ParameterSnapshot<sample_t> &published) const {
     switch (parameterType) {
     case FREQUENCY:
-      return (frequency - MIN_FREQUENCY) /
+      return (published[FREQUENCY] - MIN_FREQUENCY) /
              MAX_FREQUENCY; // noteMap.getNormalizedValue(frequency.smoothedValue);
     case GAIN:
-      return gain;
     case SOUND_SOURCE:
-      return soundSource;
     case FILTER_CUTOFF:
-      return filterCutoff;
     case FILTER_QUALITY:
-      return filterQuality;
     case ATTACK_TIME:
-      return attackTime;
     case RELEASE_TIME:
-      return releaseTime;
-      break;
     case OCTAVE:
-      return octave;
+      return published[parameterType];
     case _SIZE_ContinuousParameterType:
       break;
     }
     return 0;
   }
+
+  inline const sample_t
+  getParameter(const ContinuousParameterType parameterType) const {
+    return normalizedParameter(parameterType, getReadback().parameters);
+  }
+
+  inline const sample_t
+  getSmoothedParameter(const ContinuousParameterType parameterType) const {
+    return normalizedParameter(parameterType,
+                               getReadback().smoothedParameters);
+  }
 };
@@ -1,109 +1,52 @@
 #pragma once
 
 #include "algae.h"
+#include "synthesis_oscillator_bank.h"
 #include "synthesis_parameter.h"
+#include "synthesis_voice_allocator.h"
 #include <cstddef>
+#include <type_traits>
+#include <utility>
 using algae::dsp::math::clamp;
 using algae::dsp::math::lerp;
 
-// template <typename sample_t, typename DerivedT>
-// struct AbstractPolyphonicSynthesizer {
-//
-//   static const size_t MAX_VOICES = 8;
-//   size_t voiceIndex = 0;
-//   sample_t gain = 1;
-//   sample_t notes[MAX_VOICES] = {-1, -1, -1, -1, -1, -1, -1, -1};
-//   sample_t sampleRate = 48000;
-//
-//   inline const sample_t next() {
-//     sample_t out = 0;
-//     for (auto &voice : static_cast<DerivedT *>(this)->voices) {
-//       if (voice.active) {
-//         out += voice.next();
-//       }
-//     }
-//     return (out * gain * 0.1);
-//   }
-//
-//   inline void process(sample_t *buffer, const size_t bufferSize) {
-//     for (size_t i = 0; i < bufferSize; ++i) {
-//       buffer[i] = next();
-//     }
-//   }
-//
-//   inline void note(sample_t frequency, sample_t gate) {
-//     auto voices = static_cast<DerivedT *>(this)->voices;
-//     if (gate > 0) {
-//       voices[voiceIndex].setGate(true);
-//       voices[voiceIndex].active = true;
-//       voices[voiceIndex].gain = gain;
-//       voices[voiceIndex].frequency.set(frequency, 5, sampleRate);
-//       notes[voiceIndex] = frequency;
-//       ++voiceIndex;
-//       if (voiceIndex >= MAX_VOICES)
-//         voiceIndex = 0;
-//     } else {
-//       for (size_t i = 0; i < MAX_VOICES; ++i) {
-//         if (notes[i] == frequency) {
-//           voices[i].setGate(false);
-//           notes[i] = -1;
-//           break;
-//         }
-//       }
-//     }
-//   }
-//
-//   inline void bendNote(const sample_t frequency,
-//                        const sample_t destinationFrequency) {
-//     for (size_t i = 0; i < MAX_VOICES; ++i) {
-//       if (notes[i] == frequency) {
-//         static_cast<DerivedT *>(this)->voices[i].frequency.set(
-//             destinationFrequency, 30.0, sampleRate);
-//       }
-//     }
-//   }
-//
-//   inline void setGain(sample_t value) { gain = value; }
-//
-//   inline void setFilterCutoff(sample_t value) {
-//     value = lerp<sample_t>(500, 19000, value);
-//     for (auto &voice : static_cast<DerivedT *>(this)->voices) {
-//       voice.filterCutoff = value;
-//     }
-//   }
-//
-//   inline void setFilterQuality(sample_t value) {
-//     value = clamp<sample_t>(value, 0.001, 1);
-//     value *= 3;
-//     for (auto &voice : static_cast<DerivedT *>(this)->voices) {
-//       voice.filterQuality = value;
-//     }
-//   }
-//
-//   inline void setSoundSource(sample_t value) {
-//     value = clamp<sample_t>(value, 0, 1);
-//     for (auto &voice : static_cast<DerivedT *>(this)->voices) {
-//       voice.osc.oscMix = value;
-//     }
-//   }
-//
-//   inline void setAttackTime(sample_t value) {
-//     value *= 1000;
-//     for (auto &voice : static_cast<DerivedT *>(this)->voices) {
-//       voice.attackTime = value;
-//     }
-//   }
-//
-//   inline void setReleaseTime(sample_t value) {
-//     value *= 1000;
-//     for (auto &voice : static_cast<DerivedT *>(this)->voices) {
-//       voice.releaseTime = value;
-//     }
-//   }
-// };
+template <typename sample_t>
+static inline const EnvelopeStage
+GetEnvelopeStage(const algae::dsp::control::ASREnvelope<sample_t> &env) {
+  typedef algae::dsp::control::ASREnvelope<sample_t> Envelope;
+  switch (env.stage) {
+  case Envelope::Stage::ATTACK:
+    return ENVELOPE_ATTACK;
+  case Envelope::Stage::SUSTAIN:
+    return ENVELOPE_SUSTAIN;
+  case Envelope::Stage::RELEASE:
+    return ENVELOPE_RELEASE;
+  case Envelope::Stage::OFF:
+    return ENVELOPE_OFF;
+  }
+  return ENVELOPE_OFF;
+}
+
+template <typename sample_t>
+static inline const EnvelopeStage
+GetEnvelopeStage(const algae::dsp::control::ADEnvelope<sample_t> &env) {
+  typedef algae::dsp::control::ADEnvelope<sample_t> Envelope;
+  switch (env.stage) {
+  case Envelope::Stage::ATTACK:
+    return ENVELOPE_ATTACK;
+  case Envelope::Stage::DECAY:
+    return ENVELOPE_RELEASE;
+  case Envelope::Stage::OFF:
+    return ENVELOPE_OFF;
+  }
+  return ENVELOPE_OFF;
+}
 
 template <typename sample_t, typename DerivedT>
 struct AbstractMonophonicSynthesizer {
+  static constexpr sample_t MIN_FILTER_CUTOFF = 90;
+  static constexpr sample_t MAX_FILTER_CUTOFF = 19000;
+  static constexpr sample_t MAX_FILTER_QUALITY = 3;
 
   Parameter<sample_t> gain = Parameter<sample_t>(1);
   sample_t sampleRate = 48000;
@@ -118,23 +61,52 @@ struct AbstractMonophonicSynthesizer {
     }
   }
 
+  // For engines that declare OSCILLATORS_PER_VOICE: the voice writes a
+  // block of oscillator controls into its pool lanes, then, once the pool
+  // has rendered them, turns its lanes into output.
+  inline void prepareBlock(const OscillatorLanes<sample_t> &lanes,
+                           const size_t blockSize) {
+    static_cast<DerivedT *>(this)->voice.prepareBlock(lanes, blockSize);
+  }
+
+  inline void finishBlock(const OscillatorLanes<sample_t> &lanes,
+                          sample_t *buffer, const size_t blockSize) {
+    static_cast<DerivedT *>(this)->voice.finishBlock(lanes, buffer,
+                                                     blockSize);
+    for (size_t i = 0; i < blockSize; ++i) {
+      buffer[i] *= gain.next();
+    }
+  }
+
   inline void setGate(sample_t gate) {
     static_cast<DerivedT *>(this)->voice.setGate(gate);
   }
+
+  // true once the voice can only output silence until its next gate
+  inline const bool isIdle() const {
+    return static_cast<const DerivedT *>(this)->voice.isIdle();
+  }
+
   inline void setFrequency(sample_t value) {
     static_cast<DerivedT *>(this)->voice.frequency.set(value, 5, sampleRate);
   }
 
+  // a triggered note starts on its pitch instead of gliding from the last one
+  inline void setNoteFrequency(sample_t value) {
+    static_cast<DerivedT *>(this)->voice.frequency.snap(value);
+  }
+
   inline void setGain(sample_t value) { gain.set(value, 33, sampleRate); }
 
   inline void setFilterCutoff(sample_t value) {
     static_cast<DerivedT *>(this)->voice.filterCutoff.set(
-        lerp<sample_t>(90, 19000, value * value), 33, sampleRate);
+        lerp<sample_t>(MIN_FILTER_CUTOFF, MAX_FILTER_CUTOFF, value * value),
+        33, sampleRate);
   }
 
   inline void setFilterQuality(sample_t value) {
     value = clamp<sample_t>(value, 0.01, 1);
-    value *= 3;
+    value *= MAX_FILTER_QUALITY;
     static_cast<DerivedT *>(this)->voice.filterQuality.set(value, 33,
                                                            sampleRate);
   }
@@ -158,4 +130,287 @@ struct AbstractMonophonicSynthesizer {
                        const sample_t destinationFrequency) {
     static_cast<DerivedT *>(this)->voice.frequency = destinationFrequency;
   }
+
+  inline const EnvelopeStage envelopeStage() const {
+    return GetEnvelopeStage(static_cast<const DerivedT *>(this)->voice.env);
+  }
+
+  // Overwrites the parameters this voice smooths with how far its smoothing
+  // has got, mapped back through the setters into the values they take.
+  // FREQUENCY stays the pitch the voice plays, in Hz.
+  inline void
+  readSmoothedParameters(ParameterSnapshot<sample_t> &values) const {
+    const auto &voice = static_cast<const DerivedT *>(this)->voice;
+    const sample_t cutoff =
+        (voice.filterCutoff.smoothedValue - MIN_FILTER_CUTOFF) /
+        (MAX_FILTER_CUTOFF - MIN_FILTER_CUTOFF);
+    values[GAIN] = gain.smoothedValue;
+    values[FREQUENCY] = voice.frequency.smoothedValue;
+    values[FILTER_CUTOFF] = sqrt(clamp<sample_t>(cutoff, 0, 1));
+    values[FILTER_QUALITY] =
+        voice.filterQuality.smoothedValue / MAX_FILTER_QUALITY;
+  }
+};
+
+// How many oscillators each voice of EngineT renders through a shared
+// VoiceOscillatorPool; 0 for engines that render voice by voice.
+template <typename EngineT, typename = void>
+struct OscillatorsPerVoice : std::integral_constant<size_t, 0> {};
+
+template <typename EngineT>
+struct OscillatorsPerVoice<
+    EngineT, std::void_t<decltype(EngineT::OSCILLATORS_PER_VOICE)>>
+    : std::integral_constant<size_t, EngineT::OSCILLATORS_PER_VOICE> {};
+
+struct NoOscillatorPool {};
+
+// Runs MAX_VOICES copies of a monophonic engine behind a VoiceAllocator. Notes
+// claim or release voices by key (finger id, sequencer step, collision id)
+// and bring their own pitch; parameter setters reach only the sounding voices
+// and are replayed onto a voice when it is claimed, so idle voices cost
+// nothing per sample. Engines with OSCILLATORS_PER_VOICE keep the oscillators
+// of all voices in one VoiceOscillatorPool and render them in a single pass.
+template <typename sample_t, typename EngineT,
+          size_t MAX_VOICES = DEFAULT_MAX_VOICES>
+struct PolyphonicSynthesizer {
+  static constexpr size_t RENDER_CHUNK = OSCILLATOR_BLOCK_SIZE;
+  static constexpr size_t OSCILLATORS_PER_VOICE =
+      OscillatorsPerVoice<EngineT>::value;
+  EngineT voices[MAX_VOICES];
+  VoiceAllocator<sample_t, MAX_VOICES> allocator;
+  typename std::conditional<
+      (OSCILLATORS_PER_VOICE > 0),
+      VoiceOscillatorPool<sample_t, MAX_VOICES, OSCILLATORS_PER_VOICE>,
+      NoOscillatorPool>::type oscillatorPool;
+  size_t focusedVoice = 0;
+  sample_t frequency = 440;
+  sample_t gain = 1;
+  sample_t filterCutoff = 1;
+  sample_t filterQuality = 0;
+  sample_t soundSource = 0;
+  sample_t attackTime = 0;
+  sample_t releaseTime = 1;
+
+  PolyphonicSynthesizer() {}
+
+  template <typename ArgT>
+  explicit PolyphonicSynthesizer(ArgT *engineArgument)
+      : PolyphonicSynthesizer(std::make_index_sequence<MAX_VOICES>(),
+                              engineArgument) {}
+
+  template <typename ArgT, size_t... VoiceIndices>
+  PolyphonicSynthesizer(std::index_sequence<VoiceIndices...>,
+                        ArgT *engineArgument)
+      : voices{(static_cast<void>(VoiceIndices), EngineT(engineArgument))...} {
+  }
+
+  inline const sample_t next() {
+    sample_t out = 0;
+    process(&out, 1);
+    return out;
+  }
+
+  inline void process(sample_t *buffer, const size_t bufferSize) {
+    for (size_t j = 0; j < bufferSize; ++j) {
+      buffer[j] = 0;
+    }
+    // an engine with nothing sounding costs only the zero fill
+    if (allocator.numActiveVoices == 0) {
+      return;
+    }
+    if constexpr (OSCILLATORS_PER_VOICE > 0) {
+      processPooled(buffer, bufferSize);
+    } else {
+      processVoiceMajor(buffer, bufferSize);
+    }
+    collectIdleVoices();
+  }
+
+  // voice-major so each voice's state stays hot for the whole block
+  inline void processVoiceMajor(sample_t *buffer, const size_t bufferSize) {
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      const size_t voiceIndex = allocator.activeVoices[i];
+      auto &voice = voices[voiceIndex];
+      sample_t peak = 0;
+      // engines render in chunks so block-aware ones can hoist their
+      // per-block work out of the sample loop
+      sample_t chunk[RENDER_CHUNK];
+      for (size_t start = 0; start < bufferSize; start += RENDER_CHUNK) {
+        const size_t chunkSize = bufferSize - start < RENDER_CHUNK
+                                     ? bufferSize - start
+                                     : RENDER_CHUNK;
+        voice.process(chunk, chunkSize);
+        for (size_t j = 0; j < chunkSize; ++j) {
+          peak = fmax(peak, fabs(chunk[j]));
+          buffer[start + j] += chunk[j];
+        }
+      }
+      allocator.trackBlockLevel(voiceIndex, peak, bufferSize);
+    }
+  }
+
+  // chunk-major: every sounding voice writes its oscillator controls, the
+  // pool renders the oscillators of all voices in one pass, then each voice
+  // filters and shapes its own lanes
+  inline void processPooled(sample_t *buffer, const size_t bufferSize) {
+    sample_t peaks[MAX_VOICES] = {};
+    sample_t chunk[RENDER_CHUNK];
+    for (size_t start = 0; start < bufferSize; start += RENDER_CHUNK) {
+      const size_t chunkSize = bufferSize - start < RENDER_CHUNK
+                                   ? bufferSize - start
+                                   : RENDER_CHUNK;
+      for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+        const size_t voiceIndex = allocator.activeVoices[i];
+        voices[voiceIndex].prepareBlock(oscillatorPool.lanes(voiceIndex),
+                                        chunkSize);
+      }
+      oscillatorPool.render(chunkSize);
+      for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+        const size_t voiceIndex = allocator.activeVoices[i];
+        voices[voiceIndex].finishBlock(oscillatorPool.lanes(voiceIndex),
+                                       chunk, chunkSize);
+        for (size_t j = 0; j < chunkSize; ++j) {
+          peaks[voiceIndex] = fmax(peaks[voiceIndex], fabs(chunk[j]));
+          buffer[start + j] += chunk[j];
+        }
+      }
+    }
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      const size_t voiceIndex = allocator.activeVoices[i];
+      allocator.trackBlockLevel(voiceIndex, peaks[voiceIndex], bufferSize);
+    }
+  }
+
+  inline void collectIdleVoices() {
+    allocator.collectIdleVoices(
+        [this](const size_t index) { return voices[index].isIdle(); });
+  }
+
+  // collected voices are not rendered, so their envelopes are not looked at
+  inline const size_t readVoices(VoiceStage *stages,
+                                 EnvelopeStage *envelopeStages,
+                                 sample_t *levels) const {
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      stages[i] = allocator.stage(i);
+      envelopeStages[i] =
+          allocator.active[i] ? voices[i].envelopeStage() : ENVELOPE_OFF;
+      levels[i] = allocator.levels[i];
+    }
+    return allocator.numActiveVoices;
+  }
+
+  // the focused voice's smoothed parameters while it sounds; with nothing
+  // sounding no voice is smoothing, and values keeps what it was given
+  inline void
+  readSmoothedParameters(ParameterSnapshot<sample_t> &values) const {
+    if (allocator.active[focusedVoice]) {
+      voices[focusedVoice].readSmoothedParameters(values);
+    }
+  }
+
+  inline void applyParameters(EngineT &voice) {
+    voice.setGain(gain);
+    voice.setFilterCutoff(filterCutoff);
+    voice.setFilterQuality(filterQuality);
+    voice.setSoundSource(soundSource);
+    voice.setAttackTime(attackTime);
+    voice.setReleaseTime(releaseTime);
+  }
+
+  // The voice starts right on pitch. Later continuous frequency moves follow
+  // it from there through setFrequency.
+  inline void noteOn(int voiceKey, sample_t pitch, sample_t gate = 1) {
+    focusedVoice = allocator.noteOn(voiceKey, pitch);
+    frequency = pitch;
+    auto &voice = voices[focusedVoice];
+    applyParameters(voice);
+    voice.setFrequency(pitch);
+    voice.setNoteFrequency(pitch);
+    voice.setGate(gate);
+  }
+
+  inline void noteOff(int voiceKey) {
+    size_t released[MAX_VOICES];
+    const size_t numReleased = allocator.noteOff(voiceKey, released);
+    for (size_t i = 0; i < numReleased; ++i) {
+      voices[released[i]].setGate(0);
+    }
+  }
+
+  inline void setStealPolicy(VoiceStealPolicy policy) {
+    allocator.stealPolicy = policy;
+  }
+
+  // continuous pitch moves follow the most recently triggered voice while it
+  // is held; released voices keep the pitch they were played at. Note pitches
+  // come with noteOn and never go through here
+  inline void setFrequency(sample_t value) {
+    if (value == frequency)
+      return;
+    frequency = value;
+    if (allocator.gates[focusedVoice]) {
+      allocator.notes[focusedVoice] = value;
+      voices[focusedVoice].setFrequency(value);
+    }
+  }
+
+  inline void bendNote(const sample_t note, const sample_t destinationNote) {
+    if (allocator.active[focusedVoice]) {
+      voices[focusedVoice].bendNote(note, destinationNote);
+    }
+  }
+
+  inline void setGain(sample_t value) {
+    if (value == gain)
+      return;
+    gain = value;
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      voices[allocator.activeVoices[i]].setGain(value);
+    }
+  }
+
+  inline void setFilterCutoff(sample_t value) {
+    if (value == filterCutoff)
+      return;
+    filterCutoff = value;
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      voices[allocator.activeVoices[i]].setFilterCutoff(value);
+    }
+  }
+
+  inline void setFilterQuality(sample_t value) {
+    if (value == filterQuality)
+      return;
+    filterQuality = value;
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      voices[allocator.activeVoices[i]].setFilterQuality(value);
+    }
+  }
+
+  inline void setSoundSource(sample_t value) {
+    if (value == soundSource)
+      return;
+    soundSource = value;
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      voices[allocator.activeVoices[i]].setSoundSource(value);
+    }
+  }
+
+  inline void setAttackTime(sample_t value) {
+    if (value == attackTime)
+      return;
+    attackTime = value;
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      voices[allocator.activeVoices[i]].setAttackTime(value);
+    }
+  }
+
+  inline void setReleaseTime(sample_t value) {
+    if (value == releaseTime)
+      return;
+    releaseTime = value;
+    for (size_t i = 0; i < allocator.numActiveVoices; ++i) {
+      voices[allocator.activeVoices[i]].setReleaseTime(value);
+    }
+  }
 };
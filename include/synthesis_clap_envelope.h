@@ -1,5 +1,6 @@
 #pragma once
 #include "algae.h"
+#include "synthesis_voice_allocator.h"
 
 using algae::dsp::oscillator::SineTable;
 
@@ -85,3 +86,17 @@ template <typename sample_t> struct ClapEnvelope {
     lastGate = gate;
   }
 };
+
+template <typename sample_t>
+static inline const EnvelopeStage
+GetEnvelopeStage(const ClapEnvelope<sample_t> &env) {
+  switch (env.stage) {
+  case ClapEnvelope<sample_t>::ATTACK:
+    return ENVELOPE_ATTACK;
+  case ClapEnvelope<sample_t>::RELEASE:
+    return ENVELOPE_RELEASE;
+  case ClapEnvelope<sample_t>::OFF:
+    return ENVELOPE_OFF;
+  }
+  return ENVELOPE_OFF;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algae.h>
+#include <cmath>
+#include <cstddef>
+
+using algae::dsp::math::clamp;
+using algae::dsp::math::Pi;
+
+template <typename sample_t> struct BiquadCoefficients {
+  sample_t b0 = 1;
+  sample_t b1 = 0;
+  sample_t b2 = 0;
+  sample_t a1 = 0;
+  sample_t a2 = 0;
+
+  // RBJ cookbook designs, normalized by a0
+  static inline const BiquadCoefficients<sample_t>
+  lowpass(sample_t cosw, sample_t alpha) {
+    const sample_t a0 = 1.0 / (1.0 + alpha);
+    return {.b0 = sample_t((1.0 - cosw) * 0.5 * a0),
+            .b1 = sample_t((1.0 - cosw) * a0),
+            .b2 = sample_t((1.0 - cosw) * 0.5 * a0),
+            .a1 = sample_t(-2.0 * cosw * a0),
+            .a2 = sample_t((1.0 - alpha) * a0)};
+  }
+
+  static inline const BiquadCoefficients<sample_t>
+  bandpass(sample_t cosw, sample_t alpha) {
+    const sample_t a0 = 1.0 / (1.0 + alpha);
+    return {.b0 = sample_t(alpha * a0),
+            .b1 = 0,
+            .b2 = sample_t(-alpha * a0),
+            .a1 = sample_t(-2.0 * cosw * a0),
+            .a2 = sample_t((1.0 - alpha) * a0)};
+  }
+
+  static inline const BiquadCoefficients<sample_t>
+  highpass(sample_t cosw, sample_t alpha) {
+    const sample_t a0 = 1.0 / (1.0 + alpha);
+    return {.b0 = sample_t((1.0 + cosw) * 0.5 * a0),
+            .b1 = sample_t(-(1.0 + cosw) * a0),
+            .b2 = sample_t((1.0 + cosw) * 0.5 * a0),
+            .a1 = sample_t(-2.0 * cosw * a0),
+            .a2 = sample_t((1.0 - alpha) * a0)};
+  }
+
+  inline void step(const BiquadCoefficients<sample_t> &increment) {
+    b0 += increment.b0;
+    b1 += increment.b1;
+    b2 += increment.b2;
+    a1 += increment.a1;
+    a2 += increment.a2;
+  }
+
+  static inline const BiquadCoefficients<sample_t>
+  slope(const BiquadCoefficients<sample_t> &from,
+        const BiquadCoefficients<sample_t> &to, const size_t numSteps) {
+    const sample_t scale = 1.0 / sample_t(numSteps);
+    return {.b0 = (to.b0 - from.b0) * scale,
+            .b1 = (to.b1 - from.b1) * scale,
+            .b2 = (to.b2 - from.b2) * scale,
+            .a1 = (to.a1 - from.a1) * scale,
+            .a2 = (to.a2 - from.a2) * scale};
+  }
+};
+
+// Drop-in replacement for algae's Biquad for voices that retune their filter
+// every sample. lowpass/bandpass/highpass only record the requested response;
+// the trig-based design runs once every CONTROL_PERIOD samples, and only if
+// the cutoff or Q actually moved. Coefficients are ramped linearly between
+// designs so smoothed cutoff sweeps stay free of zipper noise.
+template <typename sample_t, size_t CONTROL_PERIOD = 32>
+struct ControlRateBiquad {
+  enum Response { LOWPASS, BANDPASS, HIGHPASS };
+  static constexpr sample_t MIN_QUALITY = 0.001;
+  static constexpr sample_t FREQUENCY_TOLERANCE = 0.0005;
+  static constexpr sample_t QUALITY_TOLERANCE = 0.0005;
+
+  BiquadCoefficients<sample_t> coefficients;
+  BiquadCoefficients<sample_t> target;
+  BiquadCoefficients<sample_t> increment;
+  Response response = LOWPASS;
+  Response targetResponse = LOWPASS;
+  sample_t frequency = 19000;
+  sample_t quality = 0.5;
+  sample_t sampleRate = 48000;
+  sample_t targetFrequency = -1;
+  sample_t targetQuality = -1;
+  size_t samplesUntilUpdate = 0;
+  bool ramping = false;
+  bool primed = false;
+  sample_t x1 = 0;
+  sample_t x2 = 0;
+  sample_t y1 = 0;
+  sample_t y2 = 0;
+
+  inline void lowpass(sample_t f, sample_t q, sample_t sr) {
+    request(LOWPASS, f, q, sr);
+  }
+
+  inline void bandpass(sample_t f, sample_t q, sample_t sr) {
+    request(BANDPASS, f, q, sr);
+  }
+
+  inline void highpass(sample_t f, sample_t q, sample_t sr) {
+    request(HIGHPASS, f, q, sr);
+  }
+
+  inline void request(Response r, sample_t f, sample_t q, sample_t sr) {
+    response = r;
+    frequency = f;
+    quality = q;
+    sampleRate = sr;
+  }
+
+  inline const bool targetIsStale() const {
+    return (response != targetResponse) ||
+           (fabs(frequency - targetFrequency) >
+            FREQUENCY_TOLERANCE * targetFrequency) ||
+           (fabs(quality - targetQuality) > QUALITY_TOLERANCE);
+  }
+
+  inline void design() {
+    targetResponse = response;
+    targetFrequency = frequency;
+    targetQuality = quality;
+    const sample_t f = clamp<sample_t>(frequency, 1, sampleRate * 0.49);
+    const sample_t q = fmax(quality, MIN_QUALITY);
+    const sample_t w0 = 2.0 * Pi<sample_t>() * f / sampleRate;
+    const sample_t cosw = cos(w0);
+    const sample_t alpha = sin(w0) / (2.0 * q);
+    switch (response) {
+    case LOWPASS:
+      target = BiquadCoefficients<sample_t>::lowpass(cosw, alpha);
+      break;
+    case BANDPASS:
+      target = BiquadCoefficients<sample_t>::bandpass(cosw, alpha);
+      break;
+    case HIGHPASS:
+      target = BiquadCoefficients<sample_t>::highpass(cosw, alpha);
+      break;
+    }
+  }
+
+  inline void updateControl() {
+    samplesUntilUpdate = CONTROL_PERIOD;
+    if (!primed) {
+      design();
+      coefficients = target;
+      primed = true;
+      ramping = false;
+    } else if (targetIsStale()) {
+      design();
+      increment = BiquadCoefficients<sample_t>::slope(coefficients, target,
+                                                      CONTROL_PERIOD);
+      ramping = true;
+    } else if (ramping) {
+      // land exactly on the target so rounding in the ramp cannot accumulate
+      coefficients = target;
+      ramping = false;
+    }
+  }
+
+  inline const sample_t next(const sample_t x) {
+    if (samplesUntilUpdate == 0) {
+      updateControl();
+    }
+    --samplesUntilUpdate;
+    const sample_t y = coefficients.b0 * x + coefficients.b1 * x1 +
+                       coefficients.b2 * x2 - coefficients.a1 * y1 -
+                       coefficients.a2 * y2;
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    if (ramping) {
+      coefficients.step(increment);
+    }
+    return y;
+  }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "SDL_log.h"
+#include "fast_math.h"
 #include "synthesis_abstract.h"
 #include "synthesis_clap_envelope.h"
 #include "synthesis_mixing.h"
@@ -32,7 +33,6 @@ using algae::dsp::oscillator::PolyBLEPSaw;
 using algae::dsp::oscillator::PolyBLEPSquare;
 using algae::dsp::oscillator::PolyBLEPTri;
 using algae::dsp::oscillator::SinOscillator;
-using algae::dsp::oscillator::WhiteNoise;
 
 template <typename sample_t> struct FMOperator {
   sample_t sampleRate = 48000;
@@ -135,7 +135,7 @@ template <typename sample_t> struct FM4OpVoice {
                                          gainSettings[nextTopologyIndex][3],
                                          topologyMantissa);
 
-    return tanh(out * 0.5) * 0.5;
+    return fastTanh(out * sample_t(0.5)) * 0.5;
   }
 
   inline void setGate(sample_t gate) {
@@ -144,11 +144,18 @@ template <typename sample_t> struct FM4OpVoice {
     op3.env.setGate(gate);
     op4.env.setGate(gate);
   }
+
+  // every operator shares one envelope shape and gate, and op1 is a carrier
+  // in every topology, so its envelope ends last
+  inline const bool isIdle() const {
+    return op1.env.stage == ASREnvelope<sample_t>::Stage::OFF;
+  }
 };
 
 template <typename sample_t>
 struct FMSynthesizer
     : AbstractMonophonicSynthesizer<sample_t, FMSynthesizer<sample_t>> {
+  static constexpr sample_t MAX_INDEX = 1.1;
   FM4OpVoice<sample_t> voice;
   sample_t sampleRate = 48000;
   inline void setFilterCutoff(sample_t value) {
@@ -157,7 +164,7 @@ struct FMSynthesizer
     value *= value;
     //  auto fb = lerp<sample_t>(0.0, 1.0, pow(1, value));
 
-    voice.index.set(value * 1.1, 5, sampleRate);
+    voice.index.set(value * MAX_INDEX, 5, sampleRate);
   }
 
   inline void setFilterQuality(sample_t value) {
@@ -185,4 +192,17 @@ struct FMSynthesizer
     voice.op3.env.setReleaseTime(value, this->sampleRate);
     voice.op4.env.setReleaseTime(value, this->sampleRate);
   }
+
+  // op1 is the carrier isIdle watches
+  inline const EnvelopeStage envelopeStage() const {
+    return GetEnvelopeStage(voice.op1.env);
+  }
+
+  inline void
+  readSmoothedParameters(ParameterSnapshot<sample_t> &values) const {
+    const sample_t index = voice.index.smoothedValue / MAX_INDEX;
+    values[GAIN] = this->gain.smoothedValue;
+    values[FREQUENCY] = voice.frequency.smoothedValue;
+    values[FILTER_CUTOFF] = sqrt(sqrt(clamp<sample_t>(index, 0, 1)));
+  }
 };
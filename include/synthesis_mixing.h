@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 template <typename sample_t>
 inline const sample_t linearXFade4(sample_t one, sample_t two, sample_t three,
                                    sample_t four, sample_t mixAmount) {
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Every noise source takes its starting state from one process-wide sequence.
+// Calling seedNoise() before a synthesizer is built makes everything it
+// renders reproducible, which the offline renderer relies on.
+inline std::atomic<uint32_t> noiseSeedSequence = 0x9E3779B9;
+
+inline void seedNoise(const uint32_t seed) { noiseSeedSequence.store(seed); }
+
+// splitmix-style hash of the next sequence value so neighbouring generators
+// do not start out correlated; never returns 0, which would stall xorshift
+inline const uint32_t nextNoiseSeed() {
+  uint32_t z = noiseSeedSequence.fetch_add(0x9E3779B9);
+  z = (z ^ (z >> 16)) * 0x85EBCA6B;
+  z = (z ^ (z >> 13)) * 0xC2B2AE35;
+  z = z ^ (z >> 16);
+  return z == 0 ? 1 : z;
+}
+
+// xorshift32 white noise in [-1, 1)
+template <typename sample_t> struct SeededWhiteNoise {
+  uint32_t state = nextNoiseSeed();
+
+  inline void seed(const uint32_t value) { state = value == 0 ? 1 : value; }
+
+  inline const sample_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return sample_t(int32_t(state)) * sample_t(1.0 / 2147483648.0);
+  }
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "simd.h"
+#include "synthesis_noise.h"
+#include <algae.h>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+using algae::dsp::oscillator::computePhaseIncrement;
+
+// frames a VoiceOscillatorPool renders at once
+static constexpr size_t OSCILLATOR_BLOCK_SIZE = 64;
+
+// One MultiOscillator tick (polyBLEP saw and square, leaky-integrated
+// triangle, xorshift noise, four-way crossfade) written against the simd.h
+// overloads. V is simd::vfloat / simd::vuint for the vector path or
+// float / uint32_t for the scalar fallback, so both paths share one kernel.
+template <typename V> inline V oscillatorBankBlep(V t, V dt) {
+  const V one = simd::splat<V>(1);
+  const V zero = simd::splat<V>(0);
+  const V low = t / dt;
+  const V lowCorrection = low + low - low * low - one;
+  const V high = (t - one) / dt;
+  const V highCorrection = high * high + high + high + one;
+  return simd::select(simd::lessThan(t, dt), lowCorrection,
+                      simd::select(simd::greaterThan(t, one - dt),
+                                   highCorrection, zero));
+}
+
+template <typename V> inline V oscillatorBankXFade4(V one, V two, V three,
+                                                    V four, V mixAmount) {
+  const V zero = simd::splat<V>(0);
+  const V unit = simd::splat<V>(1);
+  mixAmount = mixAmount * simd::splat<V>(4);
+  const V twoMix =
+      simd::min(simd::max(mixAmount - simd::splat<V>(1), zero), unit);
+  const V threeMix =
+      simd::min(simd::max(mixAmount - simd::splat<V>(2), zero), unit);
+  const V fourMix =
+      simd::min(simd::max(mixAmount - simd::splat<V>(3), zero), unit);
+  const V oneMix = simd::max(unit - mixAmount, zero);
+  return one * oneMix + two * (twoMix - threeMix) +
+         three * (threeMix - fourMix) + four * fourMix;
+}
+
+template <typename V, typename U>
+inline V oscillatorBankTick(V &phase, const V phi, V &y1, const V oscMix,
+                            U &noiseState) {
+  const V one = simd::splat<V>(1);
+  const V half = simd::splat<V>(0.5);
+  const V safePhi = simd::max(phi, simd::splat<V>(1e-9));
+
+  V saw = phase + phase - one;
+  const V endOfPhaseStep = oscillatorBankBlep(phase, safePhi);
+  saw = saw - endOfPhaseStep;
+
+  V square =
+      simd::select(simd::lessThan(phase, half), one, simd::splat<V>(-1));
+  square = square + endOfPhaseStep;
+  V dutyPhase = phase + half;
+  dutyPhase = simd::select(simd::greaterEqual(dutyPhase, one), dutyPhase - one,
+                           dutyPhase);
+  square = square - oscillatorBankBlep(dutyPhase, safePhi);
+
+  const V triangle = phi * square + (one - phi) * y1;
+  y1 = triangle;
+
+  noiseState = noiseState ^ simd::shiftLeft(noiseState, 13);
+  noiseState = noiseState ^ simd::shiftRight(noiseState, 17);
+  noiseState = noiseState ^ simd::shiftLeft(noiseState, 5);
+  const V noise =
+      simd::toSignedFloat(noiseState) * simd::splat<V>(1.0 / 2147483648.0);
+
+  phase = phase + phi;
+  phase = simd::select(simd::greaterThan(phase, one), phase - one, phase);
+
+  return oscillatorBankXFade4(triangle * simd::splat<V>(3), square, saw, noise,
+                              oscMix);
+}
+
+// A bank of NUM_OSCILLATORS MultiOscillators stored structure-of-arrays and
+// rendered simd::LANES at a time (8 on AVX2, 4 on SSE2/NEON). Lanes past
+// NUM_OSCILLATORS are padding and never read back. processBlockScalar runs
+// the same kernel one lane at a time and is what non-float banks use. Its
+// output matches the vector path wherever the vector divide is IEEE (SSE2,
+// AVX2, arm64); armv7 NEON divides through a refined reciprocal estimate, so
+// there the two differ in the last few bits.
+template <typename sample_t, size_t NUM_OSCILLATORS> struct MultiOscillatorBank {
+  static constexpr size_t NUM_LANES = simd::roundUpToLanes(NUM_OSCILLATORS);
+  static constexpr bool VECTORIZED = std::is_same<sample_t, float>::value;
+
+  alignas(simd::ALIGNMENT) sample_t phase[NUM_LANES] = {};
+  alignas(simd::ALIGNMENT) sample_t y1[NUM_LANES] = {};
+  alignas(simd::ALIGNMENT) uint32_t noiseState[NUM_LANES];
+
+  MultiOscillatorBank() { seed(nextNoiseSeed()); }
+
+  // xorshift state must never be zero
+  inline void seed(uint32_t value) {
+    for (size_t i = 0; i < NUM_LANES; ++i) {
+      uint32_t laneSeed = value + 0x6D2B79F5u * uint32_t(i + 1);
+      noiseState[i] = laneSeed == 0 ? 1 : laneSeed;
+    }
+  }
+
+  // Renders blockSize frames with per-frame controls. Controls and output
+  // are frame-major, NUM_LANES per frame, so frame n of oscillator i sits at
+  // n * NUM_LANES + i; every array must be aligned to simd::ALIGNMENT. Each
+  // lane's state stays in registers for the whole block.
+  inline void processBlock(const sample_t *phaseIncrements,
+                           const sample_t *oscMixes, sample_t *outputs,
+                           const size_t blockSize) {
+    if constexpr (VECTORIZED) {
+      processBlockVector(phaseIncrements, oscMixes, outputs, blockSize);
+    } else {
+      processBlockScalar(phaseIncrements, oscMixes, outputs, blockSize);
+    }
+  }
+
+  inline void processBlockScalar(const sample_t *phaseIncrements,
+                                 const sample_t *oscMixes, sample_t *outputs,
+                                 const size_t blockSize) {
+    for (size_t i = 0; i < NUM_OSCILLATORS; ++i) {
+      sample_t p = phase[i];
+      sample_t history = y1[i];
+      uint32_t noise = noiseState[i];
+      for (size_t n = 0, k = i; n < blockSize; ++n, k += NUM_LANES) {
+        outputs[k] = oscillatorBankTick<sample_t, uint32_t>(
+            p, phaseIncrements[k], history, oscMixes[k], noise);
+      }
+      phase[i] = p;
+      y1[i] = history;
+      noiseState[i] = noise;
+    }
+  }
+
+  inline void processBlockVector(const float *phaseIncrements,
+                                 const float *oscMixes, float *outputs,
+                                 const size_t blockSize) {
+    for (size_t i = 0; i < NUM_LANES; i += simd::LANES) {
+      simd::vfloat p = simd::load(&phase[i]);
+      simd::vfloat history = simd::load(&y1[i]);
+      simd::vuint noise = simd::load(&noiseState[i]);
+      for (size_t n = 0, k = i; n < blockSize; ++n, k += NUM_LANES) {
+        simd::store(&outputs[k],
+                    oscillatorBankTick<simd::vfloat, simd::vuint>(
+                        p, simd::load(&phaseIncrements[k]), history,
+                        simd::load(&oscMixes[k]), noise));
+      }
+      simd::store(&phase[i], p);
+      simd::store(&y1[i], history);
+      simd::store(&noiseState[i], noise);
+    }
+  }
+};
+
+// Where one voice's oscillators sit in a VoiceOscillatorPool: frame n of the
+// voice's oscillator j is at n * stride + first + j in every array.
+template <typename sample_t> struct OscillatorLanes {
+  sample_t *phaseIncrements;
+  sample_t *oscMixes;
+  const sample_t *outputs;
+  size_t stride;
+  size_t first;
+};
+
+// One MultiOscillatorBank shared by a pool of voices, OSCILLATORS_PER_VOICE
+// lanes each, so the oscillators of all voices render in one pass. Per block,
+// voices write their per-frame controls into their lanes, the pool renders
+// every lane, and voices read their lanes back. Lanes of idle voices render
+// too; with one or two vectors per frame that is cheaper than gathering.
+template <typename sample_t, size_t NUM_VOICES, size_t OSCILLATORS_PER_VOICE>
+struct VoiceOscillatorPool {
+  typedef MultiOscillatorBank<sample_t, NUM_VOICES * OSCILLATORS_PER_VOICE>
+      Bank;
+  static constexpr size_t STRIDE = Bank::NUM_LANES;
+  static constexpr size_t BLOCK_SIZE = OSCILLATOR_BLOCK_SIZE;
+
+  Bank bank;
+  alignas(simd::ALIGNMENT) sample_t phaseIncrements[BLOCK_SIZE * STRIDE] = {};
+  alignas(simd::ALIGNMENT) sample_t oscMixes[BLOCK_SIZE * STRIDE] = {};
+  alignas(simd::ALIGNMENT) sample_t outputs[BLOCK_SIZE * STRIDE] = {};
+
+  inline OscillatorLanes<sample_t> lanes(const size_t voiceIndex) {
+    return {phaseIncrements, oscMixes, outputs, STRIDE,
+            voiceIndex * OSCILLATORS_PER_VOICE};
+  }
+
+  inline void render(const size_t blockSize) {
+    bank.processBlock(phaseIncrements, oscMixes, outputs, blockSize);
+  }
+};
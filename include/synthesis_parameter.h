@@ -3,6 +3,7 @@
 #include "synthesis_type.h"
 #include <algae.h>
 #include <atomic>
+#include <cmath>
 #include <cstddef>
 enum ContinuousParameterType {
   FREQUENCY,
@@ -195,19 +196,41 @@ static const char *getDisplayName(MomentaryParameterType type) {
 
 using algae::dsp::filter::SmoothParameter;
 
+// A target value and a one-pole that glides towards it. The filter is kept
+// here rather than in algae so snap() can move its state as well.
 template <typename sample_t> struct Parameter {
   sample_t value = 0;
-  sample_t smoothedValue;
-  SmoothParameter<sample_t> smoothingFilter;
+  sample_t smoothedValue = 0;
+  sample_t smoothingCoefficient = 0;
   Parameter<sample_t>() {}
   Parameter<sample_t>(float initialValue) : value(initialValue) {}
   inline const sample_t next() {
-    smoothedValue = smoothingFilter.next(value);
+    smoothedValue = value + smoothingCoefficient * (smoothedValue - value);
     return smoothedValue;
   }
   void set(sample_t newValue, sample_t smoothingTimeMillis,
            sample_t sampleRate) {
-    smoothingFilter.set(smoothingTimeMillis, sampleRate);
+    smoothingCoefficient =
+        exp(-sample_t(1000) / (smoothingTimeMillis * sampleRate));
     value = newValue;
   }
+  // jumps straight to newValue, e.g. the pitch of a note being triggered
+  inline void snap(sample_t newValue) {
+    value = newValue;
+    smoothedValue = newValue;
+  }
+};
+
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Audio-thread copy of every continuous parameter, read once per block.
+template <typename sample_t> struct alignas(CACHE_LINE_SIZE) ParameterSnapshot {
+  sample_t values[NUM_PARAMETER_TYPES];
+
+  inline const sample_t &operator[](ContinuousParameterType type) const {
+    return values[type];
+  }
+  inline sample_t &operator[](ContinuousParameterType type) {
+    return values[type];
+  }
 };
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "arena.h"
+#include "fast_math.h"
 #include "synthesis_abstract.h"
 #include "synthesis_clap_envelope.h"
+#include "synthesis_filter.h"
 #include "synthesis_mixing.h"
+#include "synthesis_noise.h"
 #include "synthesis_parameter.h"
 #include <algae.h>
 #include <cmath>
@@ -13,7 +16,6 @@ using algae::dsp::_Filter;
 using algae::dsp::control::ADEnvelope;
 using algae::dsp::control::ASREnvelope;
 // using algae::dsp::filter::Allpass2Comb;
-using algae::dsp::filter::Biquad;
 // using algae::dsp::filter::InterpolatedDelay;
 using algae::dsp::filter::Onepole;
 using algae::dsp::filter::Onezero;
@@ -21,12 +23,11 @@ using algae::dsp::math::clamp;
 using algae::dsp::math::clip;
 using algae::dsp::math::lerp;
 using algae::dsp::oscillator::SinOscillator;
-using algae::dsp::oscillator::WhiteNoise;
 
 template <typename sample_t>
 inline const sample_t tau2pole(sample_t tau, sample_t sampleRate) {
   tau = fmax(std::numeric_limits<sample_t>::epsilon(), fabs(tau));
-  return exp(-1.0 / (tau * sampleRate));
+  return fastExp<DEFAULT_MATH_ACCURACY, sample_t>(-1.0 / (tau * sampleRate));
 }
 
 template <typename sample_t> struct EnvelopeFollower {
@@ -86,13 +87,17 @@ template <typename sample_t> struct PickPositionCombFilter {
   }
 };
 
+// log2(0.001): the loop gain that decays a string by 60dB over its decay time
+static constexpr double LOG2_OF_T60_GAIN = -9.965784284662087;
+
 template <typename sample_t> struct StringDampingFilter {
   sample_t x1 = 0;
   sample_t c1 = 1;
   sample_t c2 = 0;
   inline const void set(sample_t freq, sample_t decayTimeSeconds,
                         sample_t stretchingFactor) {
-    sample_t gain = pow(0.001, 1 / (freq * decayTimeSeconds));
+    sample_t gain = fastExp2<DEFAULT_MATH_ACCURACY, sample_t>(LOG2_OF_T60_GAIN /
+                                                   (freq * decayTimeSeconds));
     c1 = (1 - stretchingFactor) * gain;
     c2 = stretchingFactor;
   }
@@ -111,7 +116,8 @@ template <typename sample_t> struct StringDampingFilter2 {
   sample_t h1 = 0;
   inline const void set(sample_t freq, sample_t decayTimeSeconds,
                         sample_t brightness) {
-    rho = pow(0.001, 1 / (freq * decayTimeSeconds));
+    rho = fastExp2<DEFAULT_MATH_ACCURACY, sample_t>(LOG2_OF_T60_GAIN /
+                                                   (freq * decayTimeSeconds));
     h0 = (1 + brightness) / 2.0;
     h1 = (1 - brightness) / 4.0;
   }
@@ -133,7 +139,7 @@ template <typename sample_t> struct DynamicLevelLowpassFilter {
   sample_t lpole2 = 0;
   inline void set(sample_t levelDB, sample_t freq, sample_t sampleRate) {
     l = levelDB;
-    l0 = pow(l, 1.0 / 3.0);
+    l0 = fastPow<DEFAULT_MATH_ACCURACY, sample_t>(l, 1.0 / 3.0);
     lw = algae::dsp::math::Pi<sample_t>() * freq / sampleRate;
     lgain = lw / (1 + lw);
     lpole2 = (1 - lw) / (1 + lw);
@@ -246,6 +252,12 @@ struct InterpolatedDelayArena {
 
 template <typename sample_t> struct StringVoice {
   static constexpr size_t MAX_DELAY_SAMPS = (70.0 * 48000.0) / 1000.0;
+  // The string keeps ringing after its exciter stops, so it is idle only
+  // once neither the exciter nor the loop has carried anything above
+  // TAIL_THRESHOLD for long enough to have flushed the delay line and the
+  // allpass behind it.
+  static constexpr sample_t TAIL_THRESHOLD = 0.00001;
+  static constexpr size_t RING_OUT_SAMPLES = 2 * MAX_DELAY_SAMPS;
   Parameter<sample_t> frequency = 440;
   sample_t soundSource = 0;
   Parameter<sample_t> brightness = 1;
@@ -255,7 +267,8 @@ template <typename sample_t> struct StringVoice {
   sample_t releaseTime = 1000;
   sample_t sampleRate = 48000;
   sample_t y1 = 0;
-  WhiteNoise<sample_t> exciterNoise;
+  size_t quietSamples = RING_OUT_SAMPLES;
+  SeededWhiteNoise<sample_t> exciterNoise;
   SinOscillator<sample_t, sample_t> exciterTone;
   ADEnvelope<sample_t> exciterEnvelope;
   PickDirectionFilter<sample_t> pickPositionFilter;
@@ -264,7 +277,7 @@ template <typename sample_t> struct StringVoice {
   InterpolatedDelayArena<sample_t> delay;
   StringDampingFilter2<sample_t> stringDampingFilter;
   DynamicLevelLowpassFilter<sample_t> dynamicLevelLowpassFilter;
-  Biquad<sample_t, sample_t> filter;
+  ControlRateBiquad<sample_t> filter;
 
   StringVoice(Arena *arena)
       : pickPositionCombFilter(
@@ -280,7 +293,14 @@ template <typename sample_t> struct StringVoice {
 
   void setSampleRate(sample_t sr) { sampleRate = sr; }
 
-  void setGate(sample_t gate) { exciterEnvelope.setGate(gate); }
+  void setGate(sample_t gate) {
+    exciterEnvelope.setGate(gate);
+    if (gate > 0) {
+      quietSamples = 0;
+    }
+  }
+
+  inline const bool isIdle() const { return quietSamples >= RING_OUT_SAMPLES; }
 
   const sample_t next() {
     const sample_t f = frequency.next();
@@ -313,7 +333,12 @@ template <typename sample_t> struct StringVoice {
     sample_t output = (exciter + y1);
     delay.delayTimeSamples = delaytime;
     output = delay.next(output);
-    y1 = tanh(y1) * 0.9999;
+    if (fabs(exciter) < TAIL_THRESHOLD && fabs(output) < TAIL_THRESHOLD) {
+      quietSamples += quietSamples < RING_OUT_SAMPLES ? 1 : 0;
+    } else {
+      quietSamples = 0;
+    }
+    y1 = fastTanh(y1) * 0.9999;
     y1 = stringDampingFilter.next(output);
     y1 = inharmonicFilter.next(y1);
 
@@ -323,7 +348,7 @@ template <typename sample_t> struct StringVoice {
         0.1, sampleRate);
     output = filter.next(output);
 
-    return tanh(output) * g;
+    return fastTanh(output) * g;
   }
 };
 template <typename sample_t> struct KarplusStrongSynthesizer {
@@ -332,6 +357,8 @@ template <typename sample_t> struct KarplusStrongSynthesizer {
   sample_t sampleRate = 48000;
   Arena *arena = NULL;
 
+  // The delay lines live as long as the arena. Polyphonic copies push theirs
+  // one after another, so no copy can hand its lines back on its own.
   KarplusStrongSynthesizer<sample_t>(Arena *_arena)
       : arena(_arena), voice(StringVoice<sample_t>(_arena)) {
     init();
@@ -339,8 +366,6 @@ template <typename sample_t> struct KarplusStrongSynthesizer {
 
   inline void init() { voice.init(); }
 
-  inline void clear() { arena->clear(); }
-
   inline const sample_t next() { return voice.next() * 0.5; }
 
   inline void process(sample_t *buffer, const size_t bufferSize) {
@@ -354,10 +379,12 @@ template <typename sample_t> struct KarplusStrongSynthesizer {
     voice.setSampleRate(sampleRate);
   }
   inline void setGate(sample_t gate) { voice.setGate(gate); }
+  inline const bool isIdle() const { return voice.isIdle(); }
   inline void setGain(sample_t value) { voice.gain.set(value, 5, sampleRate); }
   inline void setFrequency(sample_t value) {
     voice.frequency.set(value, 33, sampleRate);
   }
+  inline void setNoteFrequency(sample_t value) { voice.frequency.snap(value); }
   inline void setSoundSource(sample_t value) { voice.soundSource = value; }
 
   inline void setFilterCutoff(sample_t value) {
@@ -380,6 +407,19 @@ template <typename sample_t> struct KarplusStrongSynthesizer {
                        const sample_t destinationFrequency) {
     voice.frequency = destinationFrequency;
   }
+
+  // the string rings on after the exciter; the allocator's stage covers that
+  inline const EnvelopeStage envelopeStage() const {
+    return GetEnvelopeStage(voice.exciterEnvelope);
+  }
+
+  inline void
+  readSmoothedParameters(ParameterSnapshot<sample_t> &values) const {
+    values[GAIN] = voice.gain.smoothedValue;
+    values[FREQUENCY] = voice.frequency.smoothedValue;
+    values[FILTER_CUTOFF] = voice.brightness.smoothedValue;
+    values[FILTER_QUALITY] = voice.inharmonicity.smoothedValue;
+  }
 };
 // template <typename sample_t> struct KarplusStringVoice {
 //   sample_t active = false;
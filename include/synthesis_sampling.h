@@ -3,15 +3,18 @@
 // #include "SDL_audio.h"
 #include "SDL_log.h"
 #include "arena.h"
+#include "fast_math.h"
 #include "sample_bank.h"
+#include "sample_library.h"
 #include "sample_load.h"
+#include "sample_stream.h"
 #include "synthesis_abstract.h"
+#include "synthesis_filter.h"
 #include "synthesis_parameter.h"
 #include <algae.h>
 #include <vector>
 
 using algae::dsp::control::ASREnvelope;
-using algae::dsp::filter::Biquad;
 using algae::dsp::math::clamp;
 using algae::dsp::math::clip;
 using algae::dsp::math::lerp;
@@ -19,32 +22,42 @@ using algae::dsp::math::mtof;
 using algae::dsp::oscillator::blep;
 using algae::dsp::oscillator::computePhaseIncrement;
 
+// Plays the bank as one set of time-aligned layers and crossfades the pair
+// soundSource points at. All layers share one playback position, counted in
+// source frames, so only the two that are heard are ever read and the cost
+// does not grow with the bank.
 template <typename sample_t> struct SamplerVoice {
   Parameter<sample_t> frequency = Parameter<sample_t>(440);
   ASREnvelope<sample_t> env;
-  Biquad<sample_t, sample_t> filter;
-  // sample_t *buffer = NULL;
-  // size_t bufferSize = 0;
+  ControlRateBiquad<sample_t> filter;
+  SampleLibrary<sample_t> *library = NULL;
+  // the bank this note plays from, taken from the library at note on; NULL
+  // until a kit has been published. Only valid while the voice is sounding:
+  // once it goes idle the library may free it
   SampleBank<sample_t> *sampleBank = NULL;
   sample_t sampleRate = 48000;
-  sample_t originalSampleRate = 48000;
+  sample_t bankSampleRate = 48000;
   sample_t gain = 0;
-  sample_t phases[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-  sample_t phaseIncrements[16] = {0, 0, 0, 0, 0, 0, 0, 0,
-                                  0, 0, 0, 0, 0, 0, 0, 0};
+  sample_t position = 0;
+  // source frames per output sample per Hz; the bank's root note is C2
+  sample_t incrementPerHz = 0;
   sample_t soundSource = 0;
   sample_t attackTime = 10;
   sample_t releaseTime = 1000;
   Parameter<sample_t> filterCutoff = Parameter<sample_t>(10000);
   Parameter<sample_t> filterQuality = Parameter<sample_t>(0.01);
+  StreamedLayerReader<sample_t> layers[2];
 
-  SamplerVoice<sample_t>(SampleBank<sample_t> *bank) : sampleBank(bank) {
+  SamplerVoice<sample_t>(SampleLibrary<sample_t> *sampleLibrary)
+      : library(sampleLibrary) {
     init();
   }
 
   inline void init() {
     filter.lowpass(filterCutoff.value, filterQuality.value, sampleRate);
     env.set(attackTime, releaseTime, sampleRate);
+    // the bank converts every buffer to its own rate at load time
+    incrementPerHz = (bankSampleRate / sampleRate) / fastMtof<sample_t>(36);
   }
 
   inline void setSampleRate(sample_t sampleRate) {
@@ -52,53 +65,186 @@ template <typename sample_t> struct SamplerVoice {
     init();
   }
 
-  inline void setFrequency(const sample_t frequency,
-                           const sample_t sampleRate) {
-
-    for (size_t i = 0; i < sampleBank->size; i++) {
-      auto bufferSize = sampleBank->buffers[i]->bufferSize;
-      sample_t ratio = frequency / mtof<sample_t>(36);
-      phaseIncrements[i] = ratio * (1.0 / sample_t(bufferSize)) *
-                           (sampleRate / originalSampleRate);
-    }
-  }
-
   inline void setGate(sample_t gate) {
     env.setGate(gate);
     if (gate) {
-      for (size_t i = 0; i < sampleBank->size; ++i) {
-        phases[i] = 0;
+      sampleBank = library->acquire();
+      if (sampleBank != NULL) {
+        bankSampleRate = sampleBank->sampleRate;
+        init();
       }
+      position = 0;
+      layers[0].unbind();
+      layers[1].unbind();
     }
   }
 
-  inline const sample_t next() {
+  // positions per pass of the resident loop, and the most frames of an
+  // INT16 layer decoded at once
+  static constexpr size_t READ_CHUNK = 64;
+  static constexpr size_t DECODE_FRAMES = 512;
+
+  // linear interpolation with the read clamped to the last frame instead of
+  // a modulo, so a finished layer holds its final sample; frames holds the
+  // layer from firstFrame on
+  static inline const sample_t read(const sample_t *frames,
+                                    const size_t firstFrame,
+                                    const sample_t lastFrame,
+                                    const sample_t readPosition) {
+    const sample_t clamped =
+        readPosition < lastFrame ? readPosition : lastFrame;
+    const size_t index = size_t(clamped);
+    const size_t nextIndex = size_t(clamped + 1 < lastFrame ? clamped + 1
+                                                            : lastFrame);
+    const sample_t mantissa = clamped - sample_t(index);
+    const sample_t current = frames[index - firstFrame];
+    return current + mantissa * (frames[nextIndex - firstFrame] - current);
+  }
+
+  // Reads a layer at each of the rising positions. Float layers are read in
+  // place; INT16 layers are decoded with SIMD a window of contiguous frames
+  // at a time, each window covering as many positions as fit in it.
+  static inline void readLayer(const SampleBuffer<sample_t> *layer,
+                               const sample_t *positions, const size_t count,
+                               sample_t *output) {
+    const sample_t lastFrame = sample_t(layer->bufferSize - 1);
+    if (layer->encoding == SAMPLE_FLOAT) {
+      for (size_t i = 0; i < count; ++i) {
+        output[i] = read(layer->buffer, 0, lastFrame, positions[i]);
+      }
+      return;
+    }
+    alignas(Arena::CACHE_LINE) sample_t window[DECODE_FRAMES];
+    const size_t lastIndex = layer->bufferSize - 1;
+    size_t i = 0;
+    while (i < count) {
+      const size_t start =
+          size_t(positions[i] < lastFrame ? positions[i] : lastFrame);
+      size_t end = i + 1;
+      while (end < count &&
+             size_t(positions[end]) + 1 < start + DECODE_FRAMES) {
+        ++end;
+      }
+      const sample_t lastPosition = positions[end - 1];
+      size_t stop =
+          size_t(lastPosition < lastFrame ? lastPosition : lastFrame) + 1;
+      stop = stop < lastIndex ? stop : lastIndex;
+      layer->decode(start, stop - start + 1, window);
+      for (; i < end; ++i) {
+        output[i] = read(window, start, lastFrame, positions[i]);
+      }
+    }
+  }
+
+  inline void process(sample_t *block, const size_t blockSize) {
+    // samples may still be arriving from the loader; play what is there
+    const size_t bankSize =
+        sampleBank != NULL ? sampleBank->size.load(std::memory_order_acquire)
+                           : 0;
+    if (bankSize == 0) {
+      for (size_t i = 0; i < blockSize; ++i) {
+        block[i] = 0;
+      }
+      return;
+    }
+    // soundSource only changes between blocks, so the pair is fixed here
+    const sample_t sampleIndex =
+        soundSource * static_cast<sample_t>(bankSize - 1);
+    const size_t s1 = size_t(sampleIndex);
+    const size_t s2 = (s1 + 1) % bankSize;
+    const sample_t mantissa = sampleIndex - static_cast<sample_t>(s1);
+    const SampleBuffer<sample_t> *first = sampleBank->buffers[s1];
+    const SampleBuffer<sample_t> *second = sampleBank->buffers[s2];
+    const StreamedSample<sample_t> *firstStreamed = sampleBank->streamed[s1];
+    const StreamedSample<sample_t> *secondStreamed = sampleBank->streamed[s2];
 
-    auto nextFrequency = frequency.next();
-    setFrequency(nextFrequency, sampleRate);
     env.set(attackTime, releaseTime, sampleRate);
+    if (firstStreamed != NULL || secondStreamed != NULL) {
+      processStreamed(block, blockSize, first, second, firstStreamed,
+                      secondStreamed, mantissa);
+      return;
+    }
+
+    const sample_t firstLastFrame = sample_t(first->bufferSize - 1);
+    const sample_t secondLastFrame = sample_t(second->bufferSize - 1);
+    const sample_t lastFrame =
+        firstLastFrame > secondLastFrame ? firstLastFrame : secondLastFrame;
+    // a streamed layer coming back into the pair restarts from here
+    layers[0].unbind();
+    layers[1].unbind();
+
+    sample_t positions[READ_CHUNK];
+    sample_t firstFrames[READ_CHUNK];
+    sample_t secondFrames[READ_CHUNK];
+    for (size_t offset = 0; offset < blockSize; offset += READ_CHUNK) {
+      const size_t count =
+          blockSize - offset < READ_CHUNK ? blockSize - offset : READ_CHUNK;
+      for (size_t i = 0; i < count; ++i) {
+        positions[i] = position;
+        position += frequency.next() * incrementPerHz;
+        position = position < lastFrame ? position : lastFrame;
+      }
+      readLayer(first, positions, count, firstFrames);
+      readLayer(second, positions, count, secondFrames);
 
-    auto envelopeSample = env.next();
+      for (size_t i = 0; i < count; ++i) {
+        filter.lowpass(filterCutoff.next(), filterQuality.next(), sampleRate);
+        const sample_t a = firstFrames[i];
+        sample_t out = a + mantissa * (secondFrames[i] - a);
+        out = filter.next(out);
+        out *= env.next() * 4;
+        block[offset + i] = out * 0.5;
+      }
+    }
+  }
 
-    filter.lowpass(filterCutoff.next(), filterQuality.next(), sampleRate);
+  // same loop as process, for a pair where at least one layer plays from
+  // disk past its resident head
+  inline void processStreamed(sample_t *block, const size_t blockSize,
+                              const SampleBuffer<sample_t> *first,
+                              const SampleBuffer<sample_t> *second,
+                              const StreamedSample<sample_t> *firstStreamed,
+                              const StreamedSample<sample_t> *secondStreamed,
+                              const sample_t mantissa) {
+    layers[0].bind(sampleBank->streamer, firstStreamed, position);
+    layers[1].bind(sampleBank->streamer, secondStreamed, position);
+    const sample_t firstLastFrame =
+        firstStreamed != NULL ? sample_t(firstStreamed->numFrames - 1)
+                              : sample_t(first->bufferSize - 1);
+    const sample_t secondLastFrame =
+        secondStreamed != NULL ? sample_t(secondStreamed->numFrames - 1)
+                               : sample_t(second->bufferSize - 1);
+    const sample_t lastFrame =
+        firstLastFrame > secondLastFrame ? firstLastFrame : secondLastFrame;
 
-    sample_t sampleIndex =
-        soundSource * static_cast<sample_t>(sampleBank->size - 1);
-    int s1 = floor(sampleIndex);
-    int s2 = (s1 + 1) % sampleBank->size;
-    sample_t mantissa = sampleIndex - static_cast<sample_t>(s1);
+    for (size_t i = 0; i < blockSize; ++i) {
+      const sample_t increment = frequency.next() * incrementPerHz;
+      filter.lowpass(filterCutoff.next(), filterQuality.next(), sampleRate);
 
-    auto out = lerp(sampleBank->buffers[s1]->read(phases[s1]),
-                    sampleBank->buffers[s2]->read(phases[s2]), mantissa);
+      const sample_t a = layers[0].read(
+          first, position < firstLastFrame ? position : firstLastFrame);
+      const sample_t b = layers[1].read(
+          second, position < secondLastFrame ? position : secondLastFrame);
+      sample_t out = a + mantissa * (b - a);
+      out = filter.next(out);
+      out *= env.next() * 4;
+      block[i] = out * 0.5;
 
-    out = filter.next(out);
-    out *= env.next() * 4;
-    for (size_t i = 0; i < sampleBank->size; ++i) {
-      phases[i] += phaseIncrements[i];
-      phases[i] = phases[i] > 1 ? 1 : phases[i];
+      position += increment;
+      position = position < lastFrame ? position : lastFrame;
     }
+    layers[0].advance(position);
+    layers[1].advance(position);
+  }
+
+  inline const sample_t next() {
+    sample_t out;
+    process(&out, 1);
+    return out;
+  }
 
-    return out * 0.5;
+  inline const bool isIdle() const {
+    return env.stage == ASREnvelope<sample_t>::Stage::OFF;
   }
 };
 
@@ -114,7 +260,15 @@ struct Sampler : AbstractMonophonicSynthesizer<sample_t, Sampler<sample_t>> {
   }
 
   inline void setSoundSource(sample_t value) { voice.soundSource = value; }
-  Sampler<sample_t>(SampleBank<sample_t> *bank) : voice(bank) {
+
+  inline void process(sample_t *buffer, const size_t bufferSize) {
+    voice.process(buffer, bufferSize);
+    for (size_t i = 0; i < bufferSize; ++i) {
+      buffer[i] *= this->gain.next();
+    }
+  }
+
+  Sampler<sample_t>(SampleLibrary<sample_t> *library) : voice(library) {
     setSampleRate(this->sampleRate);
   }
 };
@@ -2,24 +2,27 @@
 #include "SDL_log.h"
 #include "synthesis_abstract.h"
 #include "synthesis_clap_envelope.h"
+#include "synthesis_filter.h"
+#include "synthesis_mixing.h"
+#include "synthesis_noise.h"
+#include "synthesis_oscillator_bank.h"
 #include "synthesis_parameter.h"
+#include "synthesis_wavetable.h"
 #include <algae.h>
 #include <cmath>
 #include <cstddef>
 
 using algae::dsp::control::ADEnvelope;
 using algae::dsp::control::ASREnvelope;
-using algae::dsp::filter::Biquad;
 using algae::dsp::math::clamp;
 using algae::dsp::math::clip;
 using algae::dsp::math::lerp;
 using algae::dsp::oscillator::blep;
 using algae::dsp::oscillator::computePhaseIncrement;
 using algae::dsp::oscillator::SineTable;
-using algae::dsp::oscillator::WhiteNoise;
 
 template <typename sample_t> struct MultiOscillator {
-  WhiteNoise<sample_t> noise;
+  SeededWhiteNoise<sample_t> noise;
   sample_t oscMix = 0;
   sample_t phase_increment = 0;
   sample_t phase = 0;
@@ -64,91 +67,17 @@ template <typename sample_t> struct MultiOscillator {
   }
 };
 
-// template <typename sample_t> struct vMultiOscillator {
-//   const int MAX_NUMBER_OF_VOICES;
-//   WhiteNoise<sample_t> *noise;
-//   sample_t *oscMix = 0;
-//   sample_t *phase_increment = 0;
-//   sample_t *phase = 0;
-//   sample_t *y1 = 0;
-//
-//   vMultiOscillator<sample_t>(const int _maxNumberOfVoices)
-//       : MAX_NUMBER_OF_VOICES(_maxNumberOfVoices) {
-//     noise = new WhiteNoise<sample_t>[MAX_NUMBER_OF_VOICES]();
-//     oscMix = new sample_t[MAX_NUMBER_OF_VOICES]();
-//     phase_increment = new sample_t[MAX_NUMBER_OF_VOICES]();
-//     phase = new sample_t[MAX_NUMBER_OF_VOICES]();
-//     y1 = new sample_t[MAX_NUMBER_OF_VOICES]();
-//   }
-//   ~vMultiOscillator<sample_t>() {
-//     delete[] noise;
-//     delete[] oscMix;
-//     delete[] phase_increment;
-//     delete[] phase;
-//     delete[] y1;
-//   }
-//
-//   inline void setFrequency(const int index, const sample_t frequency,
-//                            const sample_t sampleRate) {
-//     phase_increment[index] =
-//         computePhaseIncrement<sample_t>(frequency, sampleRate);
-//   }
-//
-//   inline const sample_t next() {
-//     sample_t voiceOuts[MAX_NUMBER_OF_VOICES];
-//     for (int i = 0; i < MAX_NUMBER_OF_VOICES; ++i) {
-//       auto phi = phase_increment[i];
-//
-//       // compute SAW
-//       sample_t sawSample = (2.0 * phase[i]) - 1.0;
-//       sample_t endOfPhaseStep = blep<sample_t>(phase[i], phi);
-//       sawSample -= endOfPhaseStep;
-//
-//       // compute SQUARE
-//       const sample_t pwidth = 0.5;
-//       sample_t squareSample = phase[i] < pwidth ? 1 : -1;
-//       squareSample += endOfPhaseStep;
-//       sample_t dutyCycleStep =
-//           blep<sample_t>(fmod(phase[i] + (1.0 - pwidth), 1.0), phi);
-//       squareSample -= dutyCycleStep;
-//
-//       // compute TRIANGLE
-//       sample_t triangleSample = phi * squareSample + (1.0 - phi) * y1[i];
-//       y1[i] = triangleSample;
-//
-//       // compute noise
-//       sample_t noiseSample = noise[i].next();
-//
-//       // update phase
-//       phase[i] += phase_increment[i]; // + pm
-//       phase[i] = phase[i] > 1 ? phase[i] - 1 : phase[i];
-//
-//       // mix output
-//       voiceOuts[i] = linearXFade4(triangleSample * 2, squareSample,
-//       sawSample,
-//                                   noiseSample, oscMix[i]);
-//     }
-//
-//     sample_t out = 0;
-//     for (auto sample : voiceOuts) {
-//       out += sample;
-//     }
-//
-//     return out;
-//   }
-// };
-
 template <typename sample_t> struct SubtractiveDrumSynthVoice {
   ClapEnvelope<sample_t> env;
   ADEnvelope<sample_t> timbreEnv;
   ADEnvelope<sample_t> pitchEnv;
-  Biquad<sample_t, sample_t> lp1;
-  Biquad<sample_t, sample_t> lp2;
-  Biquad<sample_t, sample_t> bp1;
-  Biquad<sample_t, sample_t> bp2;
-  Biquad<sample_t, sample_t> hp1;
-  MultiOscillator<sample_t> osc1;
-  MultiOscillator<sample_t> osc2;
+  ControlRateBiquad<sample_t> lp1;
+  ControlRateBiquad<sample_t> lp2;
+  ControlRateBiquad<sample_t> bp1;
+  ControlRateBiquad<sample_t> bp2;
+  ControlRateBiquad<sample_t> hp1;
+  WavetableOscillator<sample_t> wavetableOscillators[2];
+  OscillatorBackend oscillatorBackend = DEFAULT_OSCILLATOR_BACKEND;
   Parameter<sample_t> frequency = Parameter<sample_t>(440);
   Parameter<sample_t> filterCutoff = Parameter<sample_t>(19000);
   Parameter<sample_t> filterQuality = Parameter<sample_t>(0);
@@ -157,9 +86,12 @@ template <typename sample_t> struct SubtractiveDrumSynthVoice {
   sample_t releaseTime = 1000;
   sample_t detune = 15;
   sample_t pitchModulationDepth = 1000;
-  sample_t active = false;
+  // cleared when the clap envelope finishes
+  bool active = false;
   sample_t sampleRate = 48000;
   sample_t phi = 0;
+  sample_t pitchEnvelope[OSCILLATOR_BLOCK_SIZE] = {};
+  sample_t wavetableBlock[OSCILLATOR_BLOCK_SIZE] = {};
 
   SubtractiveDrumSynthVoice() { init(); }
 
@@ -178,59 +110,95 @@ template <typename sample_t> struct SubtractiveDrumSynthVoice {
     env.setGate(gate);
     pitchEnv.setGate(gate);
     timbreEnv.setGate(gate);
+    if (gate > 0) {
+      active = true;
+    }
   }
 
-  inline const sample_t next() {
-    auto soundSourceMappedToHalfCircle =
-        SineTable<sample_t, 1024>::lookup(soundSource / 4.0);
-    timbreEnv.set(lerp<sample_t>(10, 50, soundSource),
-                  lerp<sample_t>(10, 75, soundSource), sampleRate);
-    pitchEnv.set(0, lerp<sample_t>(15, 35, soundSource), sampleRate);
-
-    auto f = frequency.next();
-    auto pitchEnvSample = pitchEnv.next();
-    f += pitchEnvSample * pitchModulationDepth;
-    auto f1 = fmax(f - detune * soundSource, 0);
-    auto f2 = f + detune * soundSource;
-
-    osc1.setFrequency(f1, sampleRate);
-    osc2.setFrequency(f2, sampleRate);
-    auto timbre = clip(timbreEnv.next() + soundSource);
-    osc1.oscMix = timbre;
-    osc2.oscMix = timbre;
-
-    auto oscillatorSample = osc1.next() + osc2.next();
-
-    lp1.lowpass(pitchEnvSample * pitchModulationDepth +
-                    lerp<sample_t>(65, 10000, soundSource),
-                1 - pitchEnvSample, sampleRate);
-    auto nextFilterCutoff = filterCutoff.next();
-    auto nextFilterQuality = filterQuality.next();
-    lp2.lowpass(nextFilterCutoff, 0.01, sampleRate);
-    auto bp1Freq = lerp<sample_t>(100, 10000, soundSource);
-    auto bp2Freq = bp1Freq - detune;
-    bp1Freq += detune;
-    bp1.bandpass(bp1Freq, nextFilterQuality, sampleRate);
-    bp2.bandpass(bp2Freq, nextFilterQuality, sampleRate);
-    hp1.highpass(lerp<sample_t>(15, 80, soundSource), 0.1, sampleRate);
-    auto out = bp1.next(oscillatorSample) + bp2.next(oscillatorSample);
-    out *= soundSource;
-    out += lp1.next(oscillatorSample) * (1 - soundSource);
-    out = lp2.next(out);
-    out = hp1.next(out);
-    out *= 4;
-
-    env.set(attackTime + soundSource * 30, releaseTime, sampleRate);
-    auto envelopeSample = env.next();
-    envelopeSample *= envelopeSample;
-    envelopeSample *= envelopeSample;
-    envelopeSample *= envelopeSample;
-
-    if (env.stage == ClapEnvelope<sample_t>::OFF) {
-      active = false;
+  // the pitch envelope still leaks through for a moment after the clap
+  // envelope ends; the allocator waits for the output to be silent as well
+  inline const bool isIdle() const { return !active; }
+
+  // Two detuned oscillators on lanes first and first + 1. The pitch
+  // envelope is kept per frame for the filters in finishBlock.
+  inline void prepareBlock(const OscillatorLanes<sample_t> &lanes,
+                           const size_t blockSize) {
+    for (size_t n = 0; n < blockSize; ++n) {
+      timbreEnv.set(lerp<sample_t>(10, 50, soundSource),
+                    lerp<sample_t>(10, 75, soundSource), sampleRate);
+      pitchEnv.set(0, lerp<sample_t>(15, 35, soundSource), sampleRate);
+
+      auto f = frequency.next();
+      auto pitchEnvSample = pitchEnv.next();
+      pitchEnvelope[n] = pitchEnvSample;
+      f += pitchEnvSample * pitchModulationDepth;
+      auto f1 = fmax(f - detune * soundSource, 0);
+      auto f2 = f + detune * soundSource;
+
+      auto timbre = clip(timbreEnv.next() + soundSource);
+      const size_t k = n * lanes.stride + lanes.first;
+      switch (oscillatorBackend) {
+      case OSCILLATOR_POLYBLEP:
+        lanes.phaseIncrements[k] =
+            computePhaseIncrement<sample_t>(f1, sampleRate);
+        lanes.phaseIncrements[k + 1] =
+            computePhaseIncrement<sample_t>(f2, sampleRate);
+        lanes.oscMixes[k] = timbre;
+        lanes.oscMixes[k + 1] = timbre;
+        break;
+      case OSCILLATOR_WAVETABLE:
+        wavetableOscillators[0].setFrequency(f1, sampleRate);
+        wavetableOscillators[1].setFrequency(f2, sampleRate);
+        wavetableOscillators[0].oscMix = timbre;
+        wavetableOscillators[1].oscMix = timbre;
+        wavetableBlock[n] =
+            wavetableOscillators[0].next() + wavetableOscillators[1].next();
+        break;
+      }
     }
+  }
 
-    return clip(out * (envelopeSample + (pitchEnvSample * 4))) * 0.5;
+  inline void finishBlock(const OscillatorLanes<sample_t> &lanes,
+                          sample_t *buffer, const size_t blockSize) {
+    for (size_t n = 0; n < blockSize; ++n) {
+      const size_t k = n * lanes.stride + lanes.first;
+      const sample_t oscillatorSample =
+          oscillatorBackend == OSCILLATOR_POLYBLEP
+              ? lanes.outputs[k] + lanes.outputs[k + 1]
+              : wavetableBlock[n];
+      const sample_t pitchEnvSample = pitchEnvelope[n];
+
+      lp1.lowpass(pitchEnvSample * pitchModulationDepth +
+                      lerp<sample_t>(65, 10000, soundSource),
+                  1 - pitchEnvSample, sampleRate);
+      auto nextFilterCutoff = filterCutoff.next();
+      auto nextFilterQuality = filterQuality.next();
+      lp2.lowpass(nextFilterCutoff, 0.01, sampleRate);
+      auto bp1Freq = lerp<sample_t>(100, 10000, soundSource);
+      auto bp2Freq = bp1Freq - detune;
+      bp1Freq += detune;
+      bp1.bandpass(bp1Freq, nextFilterQuality, sampleRate);
+      bp2.bandpass(bp2Freq, nextFilterQuality, sampleRate);
+      hp1.highpass(lerp<sample_t>(15, 80, soundSource), 0.1, sampleRate);
+      auto out = bp1.next(oscillatorSample) + bp2.next(oscillatorSample);
+      out *= soundSource;
+      out += lp1.next(oscillatorSample) * (1 - soundSource);
+      out = lp2.next(out);
+      out = hp1.next(out);
+      out *= 4;
+
+      env.set(attackTime + soundSource * 30, releaseTime, sampleRate);
+      auto envelopeSample = env.next();
+      envelopeSample *= envelopeSample;
+      envelopeSample *= envelopeSample;
+      envelopeSample *= envelopeSample;
+
+      if (env.stage == ClapEnvelope<sample_t>::OFF) {
+        active = false;
+      }
+
+      buffer[n] = clip(out * (envelopeSample + (pitchEnvSample * 4))) * 0.5;
+    }
   }
 };
 
@@ -238,6 +206,9 @@ template <typename sample_t>
 struct SubtractiveDrumSynth
     : AbstractMonophonicSynthesizer<sample_t, SubtractiveDrumSynth<sample_t>> {
 
+  // rendered through the PolyphonicSynthesizer's VoiceOscillatorPool
+  static constexpr size_t OSCILLATORS_PER_VOICE = 2;
+
   SubtractiveDrumSynthVoice<sample_t> voice;
 
   inline void setSoundSource(sample_t value) { voice.soundSource = value; }
@@ -245,7 +216,8 @@ struct SubtractiveDrumSynth
 
 template <typename sample_t> struct SubtractiveVoice {
   sample_t sampleRate = 48000.0;
-  Parameter<sample_t> active = Parameter<sample_t>(false);
+  // cleared when the envelope finishes
+  bool active = false;
   Parameter<sample_t> frequency = Parameter<sample_t>(440);
   Parameter<sample_t> soundSource = Parameter<sample_t>(0);
   Parameter<sample_t> filterCutoff = Parameter<sample_t>(19000);
@@ -253,8 +225,10 @@ template <typename sample_t> struct SubtractiveVoice {
   sample_t attackTime = 10;
   sample_t releaseTime = 1000;
 
-  MultiOscillator<sample_t> osc;
-  Biquad<sample_t, sample_t> filter;
+  WavetableOscillator<sample_t> wavetableOsc;
+  sample_t wavetableBlock[OSCILLATOR_BLOCK_SIZE] = {};
+  OscillatorBackend oscillatorBackend = DEFAULT_OSCILLATOR_BACKEND;
+  ControlRateBiquad<sample_t> filter;
   ASREnvelope<sample_t> env;
 
   SubtractiveVoice<sample_t>() { init(); }
@@ -269,21 +243,50 @@ template <typename sample_t> struct SubtractiveVoice {
     init();
   }
 
-  inline void setGate(sample_t gate) { env.setGate(gate); }
+  inline void setGate(sample_t gate) {
+    env.setGate(gate);
+    if (gate > 0) {
+      active = true;
+    }
+  }
 
-  inline const sample_t next() {
-    osc.setFrequency(frequency.next(), sampleRate);
-    osc.oscMix = soundSource.next();
-    auto out = osc.next();
-    env.set(attackTime, releaseTime, sampleRate);
-    auto envelopeSample = env.next();
-    if (env.stage == ASREnvelope<sample_t>::Stage::OFF) {
-      active = false;
+  inline const bool isIdle() const { return !active; }
+
+  inline void prepareBlock(const OscillatorLanes<sample_t> &lanes,
+                           const size_t blockSize) {
+    for (size_t n = 0; n < blockSize; ++n) {
+      const size_t k = n * lanes.stride + lanes.first;
+      switch (oscillatorBackend) {
+      case OSCILLATOR_POLYBLEP:
+        lanes.phaseIncrements[k] =
+            computePhaseIncrement<sample_t>(frequency.next(), sampleRate);
+        lanes.oscMixes[k] = soundSource.next();
+        break;
+      case OSCILLATOR_WAVETABLE:
+        wavetableOsc.setFrequency(frequency.next(), sampleRate);
+        wavetableOsc.oscMix = soundSource.next();
+        wavetableBlock[n] = wavetableOsc.next();
+        break;
+      }
     }
-    filter.lowpass(filterCutoff.next(), filterQuality.next(), sampleRate);
+  }
 
-    out = filter.next(out);
-    return out * envelopeSample;
+  inline void finishBlock(const OscillatorLanes<sample_t> &lanes,
+                          sample_t *buffer, const size_t blockSize) {
+    for (size_t n = 0; n < blockSize; ++n) {
+      sample_t out = oscillatorBackend == OSCILLATOR_POLYBLEP
+                         ? lanes.outputs[n * lanes.stride + lanes.first]
+                         : wavetableBlock[n];
+      env.set(attackTime, releaseTime, sampleRate);
+      auto envelopeSample = env.next();
+      if (env.stage == ASREnvelope<sample_t>::Stage::OFF) {
+        active = false;
+      }
+      filter.lowpass(filterCutoff.next(), filterQuality.next(), sampleRate);
+
+      out = filter.next(out);
+      buffer[n] = out * envelopeSample;
+    }
   }
 };
 
@@ -291,5 +294,16 @@ template <typename sample_t>
 struct SubtractiveSynthesizer
     : AbstractMonophonicSynthesizer<sample_t,
                                     SubtractiveSynthesizer<sample_t>> {
+  // rendered through the PolyphonicSynthesizer's VoiceOscillatorPool
+  static constexpr size_t OSCILLATORS_PER_VOICE = 1;
+
   SubtractiveVoice<sample_t> voice;
+
+  inline void
+  readSmoothedParameters(ParameterSnapshot<sample_t> &values) const {
+    AbstractMonophonicSynthesizer<
+        sample_t, SubtractiveSynthesizer<sample_t>>::readSmoothedParameters(
+        values);
+    values[SOUND_SOURCE] = voice.soundSource.smoothedValue;
+  }
 };
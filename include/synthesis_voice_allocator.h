@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+enum VoiceStealPolicy { STEAL_OLDEST, STEAL_QUIETEST, STEAL_SAME_NOTE };
+
+// a voice's note as the allocator sees it: gate held, gate released but
+// still audible, or collected
+enum VoiceStage { VOICE_IDLE, VOICE_HELD, VOICE_RELEASING };
+
+// the stage of the envelope a voice's engine actually plays through;
+// envelopes without a sustain go from attack straight to release
+enum EnvelopeStage {
+  ENVELOPE_OFF,
+  ENVELOPE_ATTACK,
+  ENVELOPE_SUSTAIN,
+  ENVELOPE_RELEASE
+};
+
+static const size_t DEFAULT_MAX_VOICES = 8;
+
+// A gate key of ALL_VOICE_KEYS releases every held voice (mouse up, sequencer
+// stop). Callers that have no notion of fingers or steps use key 0, which
+// behaves like the old monophonic retrigger.
+static const int ALL_VOICE_KEYS = -1;
+
+// Voice bookkeeping kept as structure-of-arrays so the per-block scans (steal
+// search, release, idle check) walk a few contiguous arrays instead of
+// striding through whole voices. activeVoices is a packed list of the voice
+// indices that are currently sounding; the render loop only visits those.
+template <typename sample_t, size_t MAX_VOICES> struct VoiceAllocator {
+  static constexpr sample_t SILENCE_THRESHOLD = 0.0001;
+  static constexpr sample_t LEVEL_DECAY = 0.999;
+  static constexpr sample_t SAME_NOTE_TOLERANCE = 0.01;
+
+  VoiceStealPolicy stealPolicy = STEAL_OLDEST;
+  int keys[MAX_VOICES];
+  sample_t notes[MAX_VOICES];
+  sample_t levels[MAX_VOICES];
+  // loudest output since the last collect
+  sample_t recentPeaks[MAX_VOICES];
+  uint32_t triggerStamps[MAX_VOICES];
+  bool gates[MAX_VOICES];
+  bool active[MAX_VOICES];
+  size_t activeVoices[MAX_VOICES];
+  size_t numActiveVoices = 0;
+  uint32_t clock = 0;
+
+  VoiceAllocator() {
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      keys[i] = ALL_VOICE_KEYS;
+      notes[i] = 0;
+      levels[i] = 0;
+      recentPeaks[i] = 0;
+      triggerStamps[i] = 0;
+      gates[i] = false;
+      active[i] = false;
+    }
+  }
+
+  inline const bool findKey(const int key, size_t *index) const {
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      if (gates[i] && keys[i] == key) {
+        *index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline const size_t findOldest() const {
+    size_t oldest = 0;
+    for (size_t i = 1; i < MAX_VOICES; ++i) {
+      if ((clock - triggerStamps[i]) > (clock - triggerStamps[oldest])) {
+        oldest = i;
+      }
+    }
+    return oldest;
+  }
+
+  inline const size_t findQuietest() const {
+    // prefer released voices so held notes are only stolen as a last resort
+    size_t quietest = MAX_VOICES;
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      if (!gates[i] &&
+          (quietest == MAX_VOICES || levels[i] < levels[quietest])) {
+        quietest = i;
+      }
+    }
+    if (quietest < MAX_VOICES) {
+      return quietest;
+    }
+    quietest = 0;
+    for (size_t i = 1; i < MAX_VOICES; ++i) {
+      if (levels[i] < levels[quietest]) {
+        quietest = i;
+      }
+    }
+    return quietest;
+  }
+
+  inline const bool findSameNote(const sample_t note, size_t *index) const {
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      if (active[i] &&
+          fabs(notes[i] - note) <= SAME_NOTE_TOLERANCE * fmax(note, 1)) {
+        *index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline const bool findFree(size_t *index) const {
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      if (!active[i]) {
+        *index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline const size_t chooseVoice(const int key, const sample_t note) const {
+    size_t index = 0;
+    // a key that is still held (finger slid, sequencer step repeated) keeps
+    // its voice no matter the policy
+    if (findKey(key, &index)) {
+      return index;
+    }
+    if (stealPolicy == STEAL_SAME_NOTE && findSameNote(note, &index)) {
+      return index;
+    }
+    if (findFree(&index)) {
+      return index;
+    }
+    switch (stealPolicy) {
+    case STEAL_QUIETEST:
+      return findQuietest();
+    case STEAL_OLDEST:
+    case STEAL_SAME_NOTE:
+      break;
+    }
+    return findOldest();
+  }
+
+  inline const size_t noteOn(const int key, const sample_t note) {
+    const size_t index = chooseVoice(key, note);
+    keys[index] = key;
+    notes[index] = note;
+    // a fresh note counts as loud so it is neither collected before its
+    // attack has produced anything nor picked first by STEAL_QUIETEST
+    levels[index] = 1;
+    recentPeaks[index] = 1;
+    gates[index] = true;
+    triggerStamps[index] = ++clock;
+    if (!active[index]) {
+      active[index] = true;
+      activeVoices[numActiveVoices++] = index;
+    }
+    return index;
+  }
+
+  // releases the voice held by key (or every held voice for ALL_VOICE_KEYS);
+  // returns how many indices were written to released
+  inline const size_t noteOff(const int key, size_t *released) {
+    size_t numReleased = 0;
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+      if (gates[i] && (key == ALL_VOICE_KEYS || keys[i] == key)) {
+        gates[i] = false;
+        released[numReleased++] = i;
+      }
+    }
+    return numReleased;
+  }
+
+  inline void trackLevel(const size_t index, const sample_t sample) {
+    levels[index] = fmax(fabs(sample), levels[index] * LEVEL_DECAY);
+    recentPeaks[index] = fmax(fabs(sample), recentPeaks[index]);
+  }
+
+  inline void trackBlockLevel(const size_t index, const sample_t peak,
+                              const size_t blockSize) {
+    levels[index] =
+        fmax(peak, levels[index] * pow(LEVEL_DECAY, sample_t(blockSize)));
+    recentPeaks[index] = fmax(peak, recentPeaks[index]);
+  }
+
+  inline const VoiceStage stage(const size_t index) const {
+    if (!active[index]) {
+      return VOICE_IDLE;
+    }
+    return gates[index] ? VOICE_HELD : VOICE_RELEASING;
+  }
+
+  // Drops silent voices from the active list, so they are not rendered again
+  // until their next gate. A released voice goes once its decayed level is
+  // below the silence threshold. Any voice, held or not, goes as soon as
+  // isIdle(index) says its engine has finished (envelope off, string rung
+  // out) and nothing above the threshold came out since the last collect,
+  // without waiting for the level to decay.
+  template <typename IdleTest> inline void collectIdleVoices(IdleTest isIdle) {
+    size_t writeIndex = 0;
+    for (size_t i = 0; i < numActiveVoices; ++i) {
+      const size_t voiceIndex = activeVoices[i];
+      const bool released =
+          !gates[voiceIndex] && levels[voiceIndex] < SILENCE_THRESHOLD;
+      const bool finished =
+          recentPeaks[voiceIndex] < SILENCE_THRESHOLD && isIdle(voiceIndex);
+      recentPeaks[voiceIndex] = 0;
+      if (released || finished) {
+        active[voiceIndex] = false;
+        levels[voiceIndex] = 0;
+      } else {
+        activeVoices[writeIndex++] = voiceIndex;
+      }
+    }
+    numActiveVoices = writeIndex;
+  }
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "fast_math.h"
+#include "synthesis_noise.h"
+#include <algae.h>
+#include <cmath>
+#include <cstddef>
+
+using algae::dsp::oscillator::computePhaseIncrement;
+
+// Which oscillator the subtractive voices run. The polyBLEP MultiOscillator
+// evaluates its corrections every sample; the wavetable oscillator reads
+// precomputed band-limited tables, which is cheaper on small in-order cores.
+enum OscillatorBackend { OSCILLATOR_POLYBLEP, OSCILLATOR_WAVETABLE };
+
+static constexpr OscillatorBackend DEFAULT_OSCILLATOR_BACKEND =
+    OSCILLATOR_POLYBLEP;
+
+// Saw, square and triangle built by additive synthesis, one table per octave
+// of phase increment. Level k holds only the harmonics that stay below
+// Nyquist for increments up to 2^(k + 1) * LOWEST_PHASE_INCREMENT, so both
+// levels a read crossfades between are alias-free. Built once, on first use.
+template <typename sample_t> struct BandlimitedWavetables {
+  enum Waveform { TRIANGLE, SQUARE, SAW, NUM_WAVEFORMS };
+  static constexpr size_t TABLE_SIZE = 2048;
+  static constexpr size_t NUM_LEVELS = 12;
+  // about 12Hz at 48kHz; everything below reads level 0
+  static constexpr double LOWEST_PHASE_INCREMENT = 1.0 / 4096.0;
+
+  // one guard point per table so reads never wrap
+  sample_t tables[NUM_WAVEFORMS][NUM_LEVELS][TABLE_SIZE + 1];
+
+  BandlimitedWavetables() {
+    double sine[TABLE_SIZE];
+    double cosine[TABLE_SIZE];
+    for (size_t i = 0; i < TABLE_SIZE; ++i) {
+      sine[i] = sin(2.0 * M_PI * double(i) / double(TABLE_SIZE));
+      cosine[i] = cos(2.0 * M_PI * double(i) / double(TABLE_SIZE));
+    }
+    double sum[TABLE_SIZE];
+    for (size_t level = 0; level < NUM_LEVELS; ++level) {
+      const double maxPhaseIncrement =
+          LOWEST_PHASE_INCREMENT * double(size_t(2) << level);
+      size_t numHarmonics = size_t(0.5 / maxPhaseIncrement);
+      numHarmonics = numHarmonics < 1 ? 1 : numHarmonics;
+      numHarmonics =
+          numHarmonics > TABLE_SIZE / 2 - 1 ? TABLE_SIZE / 2 - 1 : numHarmonics;
+      for (size_t waveform = 0; waveform < NUM_WAVEFORMS; ++waveform) {
+        for (size_t i = 0; i < TABLE_SIZE; ++i) {
+          sum[i] = 0;
+        }
+        for (size_t n = 1; n <= numHarmonics; ++n) {
+          // saw has every harmonic, square and triangle only the odd ones
+          if (waveform != SAW && n % 2 == 0) {
+            continue;
+          }
+          const double *basis = waveform == TRIANGLE ? cosine : sine;
+          double amplitude;
+          switch (waveform) {
+          case TRIANGLE:
+            amplitude = -8.0 / (M_PI * M_PI * double(n * n));
+            break;
+          case SQUARE:
+            amplitude = 4.0 / (M_PI * double(n));
+            break;
+          case SAW:
+          default:
+            amplitude = -2.0 / (M_PI * double(n));
+            break;
+          }
+          // Lanczos sigma: trades a little top end for ~1% Gibbs overshoot
+          // instead of ~18%, closer to what the polyBLEP edges produce
+          const double x = M_PI * double(n) / double(numHarmonics + 1);
+          amplitude *= sin(x) / x;
+          for (size_t i = 0; i < TABLE_SIZE; ++i) {
+            sum[i] += amplitude * basis[(n * i) & (TABLE_SIZE - 1)];
+          }
+        }
+        sample_t *table = tables[waveform][level];
+        for (size_t i = 0; i < TABLE_SIZE; ++i) {
+          table[i] = sample_t(sum[i]);
+        }
+        table[TABLE_SIZE] = table[0];
+      }
+    }
+  }
+
+  static const BandlimitedWavetables<sample_t> &instance() {
+    static const BandlimitedWavetables<sample_t> wavetables;
+    return wavetables;
+  }
+};
+
+// Drop-in alternative to MultiOscillator: same controls, same
+// triangle/square/saw/noise crossfade, but every waveform is two linear table
+// reads blended across neighbouring octave levels. Only the waveforms the
+// crossfade actually hears are read. Constructing one builds the tables if
+// they do not exist yet, so voices should be created off the audio thread.
+template <typename sample_t> struct WavetableOscillator {
+  typedef BandlimitedWavetables<sample_t> Wavetables;
+  const Wavetables *wavetables = &Wavetables::instance();
+  SeededWhiteNoise<sample_t> noise;
+  sample_t oscMix = 0;
+  sample_t phase_increment = 0;
+  sample_t phase = 0;
+  size_t level = 0;
+  sample_t levelMix = 0;
+
+  inline void setFrequency(const sample_t frequency,
+                           const sample_t sampleRate) {
+    phase_increment = computePhaseIncrement<sample_t>(frequency, sampleRate);
+    const sample_t scaled =
+        phase_increment / sample_t(Wavetables::LOWEST_PHASE_INCREMENT);
+    sample_t position = scaled > 1 ? fastLog2<MATH_FAST>(scaled) : 0;
+    const sample_t highestLevel = sample_t(Wavetables::NUM_LEVELS - 1);
+    position = position < highestLevel ? position : highestLevel;
+    level = size_t(position);
+    levelMix = position - sample_t(level);
+    if (level == Wavetables::NUM_LEVELS - 1) {
+      level -= 1;
+      levelMix = 1;
+    }
+  }
+
+  inline const sample_t read(const size_t waveform, const size_t index,
+                             const sample_t fraction) const {
+    const sample_t *lower = wavetables->tables[waveform][level];
+    const sample_t *upper = wavetables->tables[waveform][level + 1];
+    const sample_t lowerSample =
+        lower[index] + fraction * (lower[index + 1] - lower[index]);
+    const sample_t upperSample =
+        upper[index] + fraction * (upper[index + 1] - upper[index]);
+    return lowerSample + levelMix * (upperSample - lowerSample);
+  }
+
+  inline const sample_t next() {
+    const sample_t position = phase * sample_t(Wavetables::TABLE_SIZE);
+    size_t index = size_t(position);
+    const sample_t fraction = position - sample_t(index);
+    index = index < Wavetables::TABLE_SIZE ? index : Wavetables::TABLE_SIZE - 1;
+
+    // same weights as linearXFade4; at most two of them are non-zero
+    const sample_t mixAmount = oscMix * 4;
+    const sample_t twoMix = fmin(fmax(mixAmount - 1, 0), 1);
+    const sample_t threeMix = fmin(fmax(mixAmount - 2, 0), 1);
+    const sample_t fourMix = fmin(fmax(mixAmount - 3, 0), 1);
+    const sample_t weights[4] = {sample_t(fmax(1 - mixAmount, 0)),
+                                 twoMix - threeMix, threeMix - fourMix,
+                                 fourMix};
+
+    sample_t out = 0;
+    // 0.75 keeps the triangle at the level of MultiOscillator's
+    if (weights[0] > 0) {
+      out += weights[0] * sample_t(0.75) *
+             read(Wavetables::TRIANGLE, index, fraction);
+    }
+    if (weights[1] > 0) {
+      out += weights[1] * read(Wavetables::SQUARE, index, fraction);
+    }
+    if (weights[2] > 0) {
+      out += weights[2] * read(Wavetables::SAW, index, fraction);
+    }
+    if (weights[3] > 0) {
+      out += weights[3] * noise.next();
+    }
+
+    phase += phase_increment;
+    phase = phase >= 1 ? phase - 1 : phase;
+    return out;
+  }
+};
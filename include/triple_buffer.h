@@ -0,0 +1,50 @@
+#pragma once
+
+#include "synthesis_parameter.h"
+#include <atomic>
+#include <cstdint>
+
+// Wait-free single-writer / single-reader handoff of a whole value. The writer
+// fills writeBuffer() and publish()es it; the reader calls latest() and gets
+// the most recently published copy. Neither side ever blocks or retries, and
+// the reader never sees a half-written value. Intermediate values the reader
+// did not get to are simply dropped.
+template <typename T> struct TripleBuffer {
+  static constexpr uint8_t INDEX_MASK = 0x3;
+  static constexpr uint8_t FRESH = 0x4;
+
+  struct alignas(CACHE_LINE_SIZE) Slot {
+    T value;
+  };
+
+  Slot slots[3];
+  std::atomic<uint8_t> middle = 1;
+  uint8_t writeIndex = 0;
+  uint8_t readIndex = 2;
+
+  TripleBuffer() {}
+
+  // only safe before either thread is running
+  inline void reset(const T &value) {
+    for (auto &slot : slots) {
+      slot.value = value;
+    }
+  }
+
+  inline T &writeBuffer() { return slots[writeIndex].value; }
+
+  inline void publish() {
+    const uint8_t previous =
+        middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+    writeIndex = previous & INDEX_MASK;
+  }
+
+  inline const T &latest() {
+    if (middle.load(std::memory_order_relaxed) & FRESH) {
+      const uint8_t previous =
+          middle.exchange(readIndex, std::memory_order_acq_rel);
+      readIndex = previous & INDEX_MASK;
+    }
+    return slots[readIndex].value;
+  }
+};
@@ -127,7 +127,8 @@ struct KeyboardUI {
             synth, KEYBOARD, ContinuousInputType::KEYBOARD_KEY, float(i),
             NUM_KEY_BUTTONS);
         saveState->sensorMapping.emitEvent(
-            synth, KEYBOARD, MomentaryInputType::KEYBOARD_GATE, 1);
+            synth, KEYBOARD, MomentaryInputType::KEYBOARD_GATE, 1,
+            static_cast<int>(fingerId));
       }
     }
     needsDraw = true;
@@ -138,11 +139,9 @@ struct KeyboardUI {
 
     if (auto buttonIdx = heldKeys[fingerId]) {
       keyButtons[buttonIdx].state = WidgetState::INACTIVE;
-      saveState->sensorMapping.emitSteppedEvent(
-          synth, KEYBOARD, ContinuousInputType::KEYBOARD_KEY, float(buttonIdx),
-          NUM_KEY_BUTTONS);
-      saveState->sensorMapping.emitEvent(synth, KEYBOARD,
-                                         MomentaryInputType::KEYBOARD_GATE, 0);
+      saveState->sensorMapping.emitEvent(
+          synth, KEYBOARD, MomentaryInputType::KEYBOARD_GATE, 0,
+          static_cast<int>(fingerId));
       heldKeys.erase(fingerId);
     }
 
@@ -171,8 +170,9 @@ struct KeyboardUI {
       if (keyButtons[i].state == WidgetState::ACTIVE) {
         keyButtons[i].state = WidgetState::INACTIVE;
 
-        saveState->sensorMapping.emitEvent(
-            synth, KEYBOARD, MomentaryInputType::KEYBOARD_GATE, 0);
+        saveState->sensorMapping.emitEvent(synth, KEYBOARD,
+                                           MomentaryInputType::KEYBOARD_GATE, 0,
+                                           ALL_VOICE_KEYS);
         heldKeys.clear();
       } else if (keyButtons[i].state == WidgetState::HOVER) {
         keyButtons[i].state = WidgetState::INACTIVE;
@@ -29,6 +29,7 @@ struct SettingsMenu {
   Button changeScaleButton;
   Button saveGameButton;
   Button loadGameButton;
+  Button audioLoadButton;
   OptionPopupUI scaleSelectPopup;
   bool needsDraw = true;
   SDL_Texture *cachedRender = NULL;
@@ -90,11 +91,24 @@ struct SettingsMenu {
                     .halfSize = {.x = buttonWidth / 2,
                                  .y = static_cast<float>(buttonHeight / 2.0)}});
 
+    audioLoadButton =
+        MakeButton(audioLoadButtonText(),
+                   {.position = {.x = shape.halfSize.x,
+                                 .y = static_cast<float>(
+                                     (buttonHeight + buttonMargin) * 3 +
+                                     shape.halfSize.y)},
+                    .halfSize = {.x = buttonWidth / 2,
+                                 .y = static_cast<float>(buttonHeight / 2.0)}});
+
     scaleSelectPopup.buildLayout(shape);
 
     needsDraw = true;
   };
 
+  inline const char *audioLoadButtonText() const {
+    return saveState->showAudioLoad ? "hide dsp load" : "show dsp load";
+  }
+
   virtual void handleFingerMove(const SDL_FingerID &fingerId,
                                 const vec2f_t &position, const float pressure){
 
@@ -174,6 +188,10 @@ struct SettingsMenu {
       buildLayout(shape);
       // filebrowser.open();
     }
+    if (DoButtonClick(&audioLoadButton, mousePosition)) {
+      saveState->showAudioLoad = !saveState->showAudioLoad;
+      audioLoadButton.label.setText(audioLoadButtonText());
+    }
     // }
 
     //    break;
@@ -221,6 +239,7 @@ struct SettingsMenu {
     DrawButton(&changeScaleButton, renderer, style);
     DrawButton(&saveGameButton, renderer, style);
     DrawButton(&loadGameButton, renderer, style);
+    DrawButton(&audioLoadButton, renderer, style);
     // }
 
     // filebrowser.draw(renderer, style);
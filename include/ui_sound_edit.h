@@ -337,7 +337,9 @@ struct SoundEditUI {
             style.unavailableColor.b, style.unavailableColor.a);
         SDL_RenderFillRect(renderer, &rect);
         auto percentRect = rect;
-        percentRect.w *= synth->getParameter(parameterType);
+        // a mapped parameter follows its input; the bar shows where the
+        // sounding voice's smoothing has got to
+        percentRect.w *= synth->getSmoothedParameter(parameterType);
         SDL_SetRenderDrawColor(renderer, style.hoverColor.r, style.hoverColor.g,
                                style.hoverColor.b, style.hoverColor.a);
         SDL_RenderFillRect(renderer, &percentRect);
@@ -12,6 +12,7 @@
 #include "SDL_surface.h"
 #include "SDL_timer.h"
 #include "SDL_video.h"
+#include "include/audio_load_meter.h"
 #include "include/collider.h"
 #include "include/game.h"
 #include "include/game_object.h"
@@ -19,6 +20,8 @@
 #include "include/mapping.h"
 #include "include/metaphor.h"
 #include "include/physics.h"
+#include "include/realtime_audio.h"
+#include "include/realtime_guard.h"
 #include "include/sample_load.h"
 #include "include/save_state.h"
 #include "include/sequencer.h"
@@ -27,6 +30,7 @@
 #include "include/synthesis_sampling.h"
 #include "include/ui.h"
 #include "include/vector_math.h"
+#include "include/widget_label.h"
 #include "include/window.h"
 #include <SDL.h>
 #include <SDL_image.h>
@@ -55,6 +59,17 @@
 #include <variant>
 #include <vector>
 
+static void logArenaStats(const char *name, const Arena &arena) {
+  const Arena::Stats &stats = arena.getStats();
+  SDL_LogInfo(0, "%s: %zu bytes used, %zu peak, %zu reserved in %zu chunks",
+              name, stats.used, stats.highWaterMark, stats.reserved,
+              stats.numChunks);
+  if (stats.failedAllocations > 0) {
+    SDL_LogError(0, "%s: %zu allocations did not fit", name,
+                 stats.failedAllocations);
+  }
+}
+
 class Framework {
 public:
   static inline void forwardAudioCallback(void *userdata, Uint8 *stream,
@@ -184,7 +199,14 @@ public:
     ss << "size: " << config.size << "\n";
     ss << "silence: " << config.silence << "\n";
 
-    LoadSoundFiles(&sampleBank);
+    sampleLibrary.sampleRate = SAMPLE_RATE;
+    sampleLibrary.streamer = sampleStreamer;
+    sampleStreamer->start();
+    sampleLoader.start(&sampleLibrary, "sounds", [](SampleKit<float> *kit) {
+      logArenaStats("sample arena", kit->arena);
+      logResidency("sample kit", makeKitResident(kit));
+    });
+    logArenaStats("delay arena", delayTimeArena);
 
     SDL_LogInfo(0, "%s", ss.str().c_str());
 
@@ -216,6 +238,8 @@ public:
          .halfSize = {.x = static_cast<float>(width / 2.0),
                       .y = static_cast<float>(height / 2.0)}});
 
+    makeAudioMemoryResident();
+    realtimeAudio.preferredCore = FindFastestCore();
     SDL_PauseAudioDevice(audioDeviceID, 0); // start playback
 
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0); // setting draw color
@@ -230,6 +254,15 @@ public:
   }
 
   ~Framework() {
+    if (audioDeviceID > 0) {
+      SDL_CloseAudioDevice(audioDeviceID);
+    }
+    sampleLoader.stop();
+    sampleStreamer->stop();
+    sampleLibrary.streamer = NULL;
+    delete sampleStreamer;
+    sampleStreamer = NULL;
+
     for (auto o : gameObjects) {
       delete o;
     }
@@ -258,7 +291,43 @@ public:
     SDL_Quit();
   }
 
+  // The delay lines are reserved up front but only written once a string
+  // rings, and a sample pack is a plain file mapping, so without this the
+  // audio thread would take their page faults. Sample kits are also made
+  // resident as they finish loading.
+  void makeAudioMemoryResident() {
+    logResidency("delay arena", MakeArenaResident(delayTimeArena));
+    MemoryResidency kits;
+    // a kit still loading is made resident when it finishes
+    sampleLibrary.forEachKit([&kits](SampleKit<float> *kit) {
+      if (kit->loaded.load(std::memory_order_acquire)) {
+        kits += makeKitResident(kit);
+      }
+    });
+    logResidency("sample kits", kits);
+  }
+
+  // the pack mapping and the decoded samples, which the audio thread only
+  // reads
+  static MemoryResidency makeKitResident(SampleKit<float> *kit) {
+    MemoryResidency residency =
+        MakeRegionResident(kit->pack.data, kit->pack.size);
+    kit->arena.forEachChunk([&residency](char *data, const size_t size) {
+      residency += MakeRegionResident(data, size);
+    });
+    return residency;
+  }
+
+  static void logResidency(const char *name,
+                           const MemoryResidency &residency) {
+    SDL_Log("%s: %zu bytes locked, %zu prefaulted", name,
+            residency.bytesLocked, residency.bytesPrefaulted);
+  }
+
   void audioCallback(Uint8 *stream, int numBytesRequested) {
+    realtimeAudio.setupIfPending();
+    RealtimeGuard::Scope realtimeScope;
+    audioLoadMeter.beginCallback();
     memset(stream, config.silence, numBytesRequested);
     /* 2 channels, 4 bytes/sample = 8
      * bytes/frame */
@@ -274,6 +343,8 @@ public:
     float *ch1Pointer = &sampleStream[0];
     float *ch2Pointer = &sampleStream[1];
 
+    synth.beginCallback(numRequestedSamplesPerChannel);
+
     for (size_t i = 0; i < numBlocks; ++i) {
       float block[fixedBlockSize];
       synth.process(block, fixedBlockSize);
@@ -286,14 +357,19 @@ public:
       }
     }
 
-    for (size_t i = 0; i < remainingSamples; ++i) {
-      // for (size_t i = 0; i < numRequestedSamplesPerChannel; ++i) {
-      auto nextSample = synth.next();
-      *ch1Pointer = nextSample;
-      *ch2Pointer = nextSample;
-      ch1Pointer += config.channels;
-      ch2Pointer += config.channels;
+    if (remainingSamples > 0) {
+      float block[fixedBlockSize];
+      synth.process(block, remainingSamples);
+      for (size_t j = 0; j < remainingSamples; ++j) {
+        auto nextSample = block[j];
+        *ch1Pointer = nextSample;
+        *ch2Pointer = nextSample;
+        ch1Pointer += config.channels;
+        ch2Pointer += config.channels;
+      }
     }
+
+    audioLoadMeter.endCallback(numRequestedSamplesPerChannel, config.freq);
   };
 
   bool loadConfig() {
@@ -339,11 +415,53 @@ public:
       break;
     }
 
+    updateAudioLoadStats();
+    realtimeAudio.logReport();
+    RealtimeGuard::logViolations();
+    sampleLibrary.collect();
+
     handleEvents(event);
     if (event.type == SDL_QUIT || (!renderIsOn))
       return;
   }
 
+  // refreshes the overlay text a few times a second and logs periodically, or
+  // right away when a new xrun shows up
+  void updateAudioLoadStats() {
+    const AudioLoadStats &stats = audioLoadMeter.latest();
+    const Uint32 now = SDL_GetTicks();
+    const uint32_t xruns = stats.overruns + stats.lateCallbacks;
+
+    if (saveState.showAudioLoad &&
+        now - lastAudioLoadLabelUpdate >= AUDIO_LOAD_LABEL_PERIOD_MILLIS) {
+      lastAudioLoadLabelUpdate = now;
+      char text[64];
+      snprintf(text, sizeof(text), "dsp %3d%% peak %3d%% xruns %u",
+               int(stats.meanLoad * 100), int(stats.peakLoad * 100), xruns);
+      audioLoadLabel.setText(text);
+    }
+
+    if (xruns != loggedXruns ||
+        now - lastAudioLoadLog >= AUDIO_LOAD_LOG_PERIOD_MILLIS) {
+      const bool newXruns = xruns != loggedXruns;
+      lastAudioLoadLog = now;
+      loggedXruns = xruns;
+      if (newXruns) {
+        SDL_LogWarn(0,
+                    "audio xrun: %u overruns, %u late callbacks; dsp load "
+                    "mean %.2f peak %.2f",
+                    stats.overruns, stats.lateCallbacks, stats.meanLoad,
+                    stats.peakLoad);
+      } else {
+        SDL_Log("dsp load mean %.2f peak %.2f over %u callbacks, %u xruns; "
+                "%u coalesced parameter changes",
+                stats.meanLoad, stats.peakLoad, stats.callbacks, xruns,
+                synth.getCoalescedParameterChanges());
+        synth.eventBus.logStats();
+      }
+    }
+  }
+
   void handleEvents(SDL_Event &event) {
 
     // Event loop
@@ -357,6 +475,10 @@ public:
         SDL_Log("Entering background");
         break;
       case SDL_APP_DIDENTERFOREGROUND:
+        // prefaulted pages may have been reclaimed in the background
+        makeAudioMemoryResident();
+        realtimeAudio.requestSetup();
+        audioLoadMeter.resume();
         SDL_PauseAudioDevice(audioDeviceID, 0);
         renderIsOn = true;
         SDL_Log("Entering foreground");
@@ -485,6 +607,15 @@ public:
     SDL_RenderClear(renderer);
 
     userInterface.draw(renderer, *style);
+    if (saveState.showAudioLoad) {
+      const float labelHeight = style->getFontHeight(FontSize::SMALL);
+      const SDL_Rect labelBox = {.x = 0,
+                                 .y = 0,
+                                 .w = int(labelHeight * 12),
+                                 .h = int(labelHeight)};
+      audioLoadLabel.draw(style->hoverColor, style->inactiveColor, labelBox,
+                          renderer, *style);
+    }
     SDL_RenderPresent(renderer);
   }
 
@@ -508,9 +639,19 @@ private:
   GameObject *wall1, *wall2, *wall3, *wall4;
   // AudioSample *audioSample = NULL;
   const int arenaSizeSeconds = 60 * 4;
-  Arena sampleArena = Arena(sizeof(float) * 48000 * arenaSizeSeconds);
-  Arena delayTimeArena = Arena(sizeof(float) * 48000 * arenaSizeSeconds);
-  SampleBank<float> sampleBank = SampleBank<float>(&sampleArena);
+  // long files stream from disk, so the bank only needs room for one-shots
+  // up to the streaming threshold plus the resident heads of the rest
+  const int sampleArenaSizeSeconds =
+      int(SampleBank<float>::MAX_BANK_SIZE *
+          SampleBank<float>::STREAM_THRESHOLD_SECONDS);
+  Arena delayTimeArena =
+      Arena(1 << 20, sizeof(float) * 48000 * arenaSizeSeconds);
+  SampleStreamer<float> *sampleStreamer = new SampleStreamer<float>();
+  // every kit gets its own arena of this size
+  SampleLibrary<float> sampleLibrary = SampleLibrary<float>(
+      sizeof(float) * 48000 * SampleBank<float>::STREAM_THRESHOLD_SECONDS,
+      sizeof(float) * 48000 * sampleArenaSizeSeconds);
+  BackgroundSampleLoader sampleLoader;
 
   Style *style = NULL;
   SDL_Texture *menuIcon = NULL;
@@ -519,7 +660,7 @@ private:
   // Model objects
   SaveState saveState;
   Synthesizer<float> synth = Synthesizer<float>(
-      &sampleBank, &delayTimeArena, saveState.getSynthesizerSettings());
+      &sampleLibrary, &delayTimeArena, saveState.getSynthesizerSettings());
 
   Sequencer sequencer = Sequencer(&synth, &saveState);
   Game game = Game(&saveState.sensorMapping, &synth);
@@ -541,6 +682,15 @@ private:
   float xDir = 0, yDir = 0;
   SDL_AudioSpec config;
 
+  AudioLoadMeter audioLoadMeter;
+  RealtimeAudioThread realtimeAudio;
+  Label audioLoadLabel;
+  const Uint32 AUDIO_LOAD_LABEL_PERIOD_MILLIS = 250;
+  const Uint32 AUDIO_LOAD_LOG_PERIOD_MILLIS = 10000;
+  Uint32 lastAudioLoadLabelUpdate = 0;
+  Uint32 lastAudioLoadLog = 0;
+  uint32_t loggedXruns = 0;
+
   int lastFrameTime = 0;
   int radius = 50;
   bool renderIsOn = true;
@@ -0,0 +1,108 @@
+#include "SDL_log.h"
+#include "include/arena.h"
+#include "include/offline_render.h"
+#include "include/sample_library.h"
+#include "include/synthesis.h"
+#include "include/synthesis_noise.h"
+#include "include/synthesizer_settings.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Renders a script of synthesizer events to a WAV file without opening a
+// window or an audio device, and reports how much faster than realtime the
+// engine ran. See include/offline_render.h for the script format.
+
+static void printUsage(const char *program) {
+  printf("usage: %s <script> <output.wav> [--seed N] [--block-size N] "
+         "[--sample file.wav]...\n",
+         program);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  const std::string scriptPath = argv[1];
+  const std::string outputPath = argv[2];
+  uint32_t seed = 1;
+  size_t blockSize = 64;
+  std::vector<std::string> samplePaths;
+  for (int i = 3; i < argc; ++i) {
+    const std::string option = argv[i];
+    if (option == "--seed" && i + 1 < argc) {
+      seed = uint32_t(strtoul(argv[++i], NULL, 10));
+    } else if (option == "--block-size" && i + 1 < argc) {
+      blockSize = strtoul(argv[++i], NULL, 10);
+    } else if (option == "--sample" && i + 1 < argc) {
+      samplePaths.push_back(argv[++i]);
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (blockSize == 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const float sampleRate = 48000;
+  std::ifstream scriptFile(scriptPath);
+  if (!scriptFile.is_open()) {
+    SDL_LogError(0, "could not open script %s", scriptPath.c_str());
+    return 1;
+  }
+  RenderScript<float> script;
+  std::string error;
+  if (!parseRenderScript<float>(scriptFile, sampleRate, &script, &error)) {
+    SDL_LogError(0, "%s: %s", scriptPath.c_str(), error.c_str());
+    return 1;
+  }
+
+  const size_t arenaSizeSeconds = 240;
+  SampleLibrary<float> sampleLibrary =
+      SampleLibrary<float>(sizeof(float) * 48000 * 10,
+                           sizeof(float) * 48000 * arenaSizeSeconds);
+  Arena delayTimeArena =
+      Arena(1 << 20, sizeof(float) * 48000 * arenaSizeSeconds);
+  SampleKit<float> *sampleKit = sampleLibrary.createKit();
+  for (auto &samplePath : samplePaths) {
+    if (!sampleKit->bank.loadSample(samplePath)) {
+      SDL_LogError(0, "could not load sample %s", samplePath.c_str());
+      delete sampleKit;
+      return 1;
+    }
+  }
+  sampleLibrary.publish(sampleKit);
+
+  // every noise generator is seeded as the synthesizer is built, so the seed
+  // has to be in place first
+  seedNoise(seed);
+  Synthesizer<float> *synth = new Synthesizer<float>(
+      &sampleLibrary, &delayTimeArena, SynthesizerSettings());
+
+  std::vector<float> output(script.numFrames, 0.0f);
+  const auto start = std::chrono::steady_clock::now();
+  renderScript<float>(synth, script, output.data(), blockSize);
+  const auto stop = std::chrono::steady_clock::now();
+
+  const double renderSeconds =
+      std::chrono::duration<double>(stop - start).count();
+  const double audioSeconds = double(script.numFrames) / sampleRate;
+  printf("rendered %.3fs of audio in %.3fs (%.1fx realtime)\n", audioSeconds,
+         renderSeconds,
+         renderSeconds > 0 ? audioSeconds / renderSeconds : 0.0);
+
+  delete synth;
+  if (!writeWAV<float>(outputPath, output.data(), output.size(),
+                       uint32_t(sampleRate))) {
+    SDL_LogError(0, "could not write %s", outputPath.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "SDL_log.h"
+#include "include/sample_pack.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Builds a sample pack ahead of time, for example as a build step, so the
+// first launch does not have to. With no WAV files given, every file in
+// sounds/ goes into sounds.pack, which is what the app looks for. Samples
+// are converted to the engine rate, 48kHz unless --rate says otherwise.
+
+static void printUsage(const char *program) {
+  printf("usage: %s [--rate N] [<output.pack> <file.wav>...]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+  std::string packPath = "sounds.pack";
+  std::vector<std::string> wavPaths;
+  // the rate the app runs its engine at
+  uint32_t sampleRate = 48000;
+  int firstPath = 1;
+  if (argc > 2 && std::string(argv[1]) == "--rate") {
+    sampleRate = uint32_t(strtoul(argv[2], NULL, 10));
+    firstPath = 3;
+  }
+  if (argc - firstPath == 1 || sampleRate == 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  if (argc - firstPath > 1) {
+    packPath = argv[firstPath];
+    for (int i = firstPath + 1; i < argc; ++i) {
+      wavPaths.push_back(argv[i]);
+    }
+  } else {
+    std::error_code error;
+    for (auto &entry :
+         std::filesystem::directory_iterator("sounds", error)) {
+      if (!std::filesystem::is_directory(entry)) {
+        wavPaths.push_back(entry.path().string());
+      }
+    }
+    if (error) {
+      SDL_LogError(0, "could not read sounds/");
+      return 1;
+    }
+    // same order the app loads them in
+    std::sort(wavPaths.begin(), wavPaths.end());
+  }
+
+  if (!WriteSamplePack(packPath, wavPaths, sampleRate)) {
+    return 1;
+  }
+  MappedSamplePack pack;
+  if (!pack.open(packPath)) {
+    SDL_LogError(0, "could not read back %s", packPath.c_str());
+    return 1;
+  }
+  for (size_t i = 0; i < pack.numEntries(); ++i) {
+    const SamplePackEntry &entry = pack.entries[i];
+    printf("%-32s %6uHz %9.2fs peak %.3f rms %.3f\n", entry.name,
+           entry.sampleRate, double(entry.numFrames) / entry.sampleRate,
+           double(entry.peak), double(entry.rms));
+  }
+  return 0;
+}